@@ -0,0 +1,91 @@
+#ifndef __ATOMICS_H
+#define __ATOMICS_H
+
+/*
+ * minimal set of atomic operations for lock-free data exchange between the
+ * main (SDL event) thread and the OSC threads.
+ * libSDL 1.2 does not provide any, so we use the GCC builtins if available.
+ */
+
+#if defined(__clang__) || \
+    (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+
+#define ATOMIC_LOAD(P)		__atomic_load_n(P, __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(P, V)	__atomic_store_n(P, V, __ATOMIC_RELEASE)
+#define ATOMIC_EXCHANGE(P, V)	__atomic_exchange_n(P, V, __ATOMIC_SEQ_CST)
+#define ATOMIC_ADD(P, V)	__atomic_add_fetch(P, V, __ATOMIC_RELAXED)
+/* drops references: prior accesses happen before an acquiring load of 0 */
+#define ATOMIC_SUB_RELEASE(P, V) __atomic_sub_fetch(P, V, __ATOMIC_RELEASE)
+#define ATOMIC_FENCE()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#elif defined(__WATCOMC__) && defined(__386__)
+
+/*
+ * Open Watcom C has no atomic builtins, so the read-modify-write
+ * operations are locked x86 instructions (emitted as bytes, since xadd is
+ * not available when targeting the i386).
+ * on the strongly ordered x86, loads and stores of the volatile shared
+ * variables only need a compiler barrier: every auxiliary pragma is
+ * assumed to modify memory.
+ * 64 bit variables may only be added to by a single thread.
+ */
+
+int Atomic_Exchange(volatile int *p, int v);
+#pragma aux Atomic_Exchange =		\
+	0x87 0x02	/* xchg [edx], eax */		\
+	parm [edx] [eax] value [eax] modify exact [eax];
+
+int Atomic_FetchAdd(volatile int *p, int v);
+#pragma aux Atomic_FetchAdd =		\
+	0xf0 0x0f 0xc1 0x02	/* lock xadd [edx], eax */	\
+	parm [edx] [eax] value [eax] modify exact [eax];
+
+void Atomic_Fence(void);
+#pragma aux Atomic_Fence =		\
+	0xf0 0x83 0x0c 0x24 0x00 /* lock or dword ptr [esp], 0 */ \
+	modify exact [];
+
+void Atomic_Barrier(void);
+#pragma aux Atomic_Barrier = "" modify exact [];
+
+#define ATOMIC_LOAD(P)		(*(P))
+#define ATOMIC_STORE(P, V)	(Atomic_Barrier(), *(P) = (V))
+#define ATOMIC_EXCHANGE(P, V)	Atomic_Exchange((volatile int *)(P), V)
+#define ATOMIC_ADD(P, V)	(sizeof(*(P)) == sizeof(int)		     \
+				 ? Atomic_FetchAdd((volatile int *)(P), V) + (V) \
+				 : (*(P) += (V)))
+#define ATOMIC_SUB_RELEASE(P, V) \
+	(Atomic_FetchAdd((volatile int *)(P), -(V)) - (V))
+#define ATOMIC_FENCE()		Atomic_Fence()
+
+#else
+
+/*
+ * FIXME: no atomic operations for this compiler. Shared variables are
+ * declared volatile, which is sufficient for the single-producer/
+ * single-consumer cases on strongly ordered targets, but the
+ * read-modify-write operations are not atomic, so packets must not be
+ * shared by several OSC threads (s.a. ATOMIC_SPSC_ONLY).
+ */
+
+#define ATOMIC_SPSC_ONLY
+
+#define ATOMIC_LOAD(P)		(*(P))
+#define ATOMIC_STORE(P, V)	(*(P) = (V))
+#define ATOMIC_EXCHANGE(P, V)	Atomic_Exchange((volatile int *)(P), V)
+#define ATOMIC_ADD(P, V)	(*(P) += (V))
+#define ATOMIC_SUB_RELEASE(P, V) (*(P) -= (V))
+#define ATOMIC_FENCE()
+
+static inline int
+Atomic_Exchange(volatile int *p, int v)
+{
+	int old = *p;
+
+	*p = v;
+	return old;
+}
+
+#endif
+
+#endif
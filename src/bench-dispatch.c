@@ -0,0 +1,165 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <SDL.h>
+
+#include "controls.h"
+#include "controller.h"
+#include "dispatch.h"
+
+/*
+ * microbenchmark of incoming OSC address resolution: lookups per second of
+ * the dispatch index versus a linear strcmp() scan of the registry for
+ * increasing numbers of controls laid out like a mixer
+ * (/mixer/bank<b>/ch<c>/{fader,pan,mute})
+ */
+
+struct Registry registry;
+struct Display display;
+
+#define BENCH_TIME	250	/* ms per measurement */
+
+static const char *params[] = {"fader", "pan", "mute"};
+
+static int
+CountControl(struct Control *c __attribute__((unused)), void *ud)
+{
+	(*(Uint32 *)ud)++;
+	return 0;
+}
+
+static Uint32
+LinearLookup(const char *address)
+{
+	Uint32 found = 0;
+
+	for (struct Tab *tab = registry.tabs;
+	     tab < registry.tabs + registry.cTabs; tab++)
+		for (struct Control *c = tab->controls;
+		     c < tab->controls + tab->cControls; c++)
+			if (c->OSC.address && !strcmp(c->OSC.address, address))
+				found++;
+
+	return found;
+}
+
+static inline double
+Now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec*1000. + tv.tv_usec/1000.;
+}
+
+static double
+Measure(char **addresses, Uint32 n, int linear, Uint32 *found)
+{
+	double	start = Now(), elapsed;
+	Uint32	lookups = 0;
+
+	*found = 0;
+
+	do {
+		for (Uint32 i = 0; i < 1024; i++, lookups++) {
+			const char *address = addresses[lookups % n];
+
+			if (linear)
+				*found += LinearLookup(address);
+			else
+				Dispatch_Lookup(address, CountControl, found);
+		}
+	} while ((elapsed = Now() - start) < BENCH_TIME);
+
+	return lookups/elapsed*1000.;
+}
+
+static int
+Setup(Uint32 controls)
+{
+	struct Tab *tab;
+
+	if (!(registry.tabs = tab = calloc(1, sizeof(struct Tab))) ||
+	    !(tab->controls = calloc(controls, sizeof(struct Control))))
+		return 1;
+	registry.cTabs = 1;
+	tab->cControls = controls;
+
+	for (Uint32 i = 0; i < controls; i++) {
+		char address[64];
+
+		snprintf(address, sizeof(address), "/mixer/bank%u/ch%u/%s",
+			 i/96, i/3 % 32, params[i % 3]);
+		if (!(tab->controls[i].OSC.address = strdup(address)))
+			return 1;
+	}
+
+	return Dispatch_BuildIndex();
+}
+
+static void
+Teardown(void)
+{
+	Dispatch_FreeIndex();
+
+	for (Uint32 i = 0; i < registry.tabs->cControls; i++)
+		free(registry.tabs->controls[i].OSC.address);
+	free(registry.tabs->controls);
+	free(registry.tabs);
+
+	memset(&registry, 0, sizeof(struct Registry));
+}
+
+int
+main(int argc, char **argv)
+{
+	static const Uint32 sizes[] = {10, 100, 500, 1000, 5000};
+
+	static char *wildcards[] = {
+		"/mixer/bank0/ch*/fader",
+		"/mixer/bank[0-1]/ch1?/{pan,mute}",
+		"/mixer/*/ch0/mute"
+	};
+
+	printf("%8s %14s %14s %14s\n",
+	       "controls", "linear/s", "index/s", "wildcard/s");
+
+	for (Uint32 s = argc > 1 ? sizeof(sizes)/sizeof(*sizes) - 1 : 0;
+	     s < sizeof(sizes)/sizeof(*sizes); s++) {
+		Uint32	controls = argc > 1 ? strtoul(argv[1], NULL, 0)
+					    : sizes[s];
+		char	**addresses;
+
+		Uint32	found[3];
+		double	linear, index, wildcard;
+
+		if (Setup(controls) ||
+		    !(addresses = malloc(controls*sizeof(char *)))) {
+			fprintf(stderr, "Out of memory\n");
+			return EXIT_FAILURE;
+		}
+
+		/* look up addresses in a different order than registered */
+		for (Uint32 i = 0; i < controls; i++)
+			addresses[i] = registry.tabs->controls[(i*7919) % controls].OSC.address;
+
+		linear = Measure(addresses, controls, 1, found);
+		index = Measure(addresses, controls, 0, found + 1);
+		wildcard = Measure(wildcards, sizeof(wildcards)/sizeof(*wildcards),
+				   0, found + 2);
+
+		printf("%8u %14.0f %14.0f %14.0f\n",
+		       controls, linear, index, wildcard);
+
+		free(addresses);
+		Teardown();
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,178 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <SDL.h>
+
+#include "controller.h"
+#include "graphics.h"
+
+/*
+ * microbenchmark of the drawing primitives on software surfaces of every
+ * depth (operations and megapixels per second) and of text rendering with
+ * every available SIMD level and from the glyph cache (glyphs per second)
+ */
+
+struct Display display;
+
+#define BENCH_WIDTH	800
+#define BENCH_HEIGHT	600
+#define BENCH_TIME	250	/* ms per measurement */
+
+#define BENCH_TEXT	"-12.5/100 label"
+
+static Uint32 colors[BENCH_HEIGHT];
+
+enum Bench_Op {
+	BENCH_HLINE = 0,
+	BENCH_VLINE,
+	BENCH_RECT,
+	BENCH_GRADFILL,
+	BENCH_TEXT_OP,
+	BENCH_OPS
+};
+
+static const char *names[BENCH_OPS] = {
+	"hline", "vline", "rect", "gradfill", "text"
+};
+
+static const int depths[] = {8, 16, 24, 32};
+
+static inline double
+Now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec*1000. + tv.tv_usec/1000.;
+}
+
+/* returns number of pixels touched per operation */
+static Uint32
+Run(SDL_Surface *s, enum Bench_Op op, Uint32 i)
+{
+	SDL_Rect rect = {
+		.x = i % 64 + 1,
+		.y = i % 32 + 1,
+		.w = 400,
+		.h = 300
+	};
+
+	switch (op) {
+	case BENCH_HLINE:
+		Graphics_DrawHLine(s, rect.x, rect.y, rect.w, colors[0]);
+		return rect.w;
+
+	case BENCH_VLINE:
+		Graphics_DrawVLine(s, rect.x, rect.y, rect.h, colors[0]);
+		return rect.h;
+
+	case BENCH_RECT:
+		Graphics_DrawRect(s, &rect, colors[0]);
+		return 2*(rect.w + rect.h);
+
+	case BENCH_GRADFILL:
+		Graphics_GradFillRect(s, &rect, colors);
+		return rect.w*rect.h;
+
+	case BENCH_TEXT_OP:
+		Graphics_WriteText(s, rect.x, rect.y, BENCH_TEXT, colors[0]);
+		return strlen(BENCH_TEXT)*FONTWIDTH*FONTHEIGHT;
+
+	default:
+		return 0;
+	}
+}
+
+static double
+Glyphs(int depth)
+{
+	SDL_Surface	*s = SDL_CreateRGBSurface(SDL_SWSURFACE,
+						  BENCH_WIDTH, BENCH_HEIGHT,
+						  depth, 0, 0, 0, 0);
+	double		start = Now(), elapsed;
+	Uint32		glyphs = 0;
+
+	if (!s)
+		return 0;
+
+	do
+		for (int i = 0; i < 64; i++, glyphs += strlen(BENCH_TEXT))
+			Graphics_WriteText(s, i, i*FONTHEIGHT, BENCH_TEXT,
+					   SDL_MapRGB(s->format, 0, 255, 0));
+	while ((elapsed = Now() - start) < BENCH_TIME);
+
+	SDL_FreeSurface(s);
+	return glyphs/elapsed*1000.;
+}
+
+int
+main(int argc, char **argv)
+{
+	enum Graphics_SIMD simd = Graphics_Init(GRAPHICS_SIMD_AVX2);
+
+	printf("%4s", "bpp");
+	for (int op = 0; op < BENCH_OPS; op++)
+		printf(" %10s/s %6s", names[op], "Mpx/s");
+	printf("\n");
+
+	for (int d = 0; d < sizeof(depths)/sizeof(*depths); d++) {
+		SDL_Surface *s = SDL_CreateRGBSurface(SDL_SWSURFACE,
+						      BENCH_WIDTH, BENCH_HEIGHT,
+						      depths[d], 0, 0, 0, 0);
+
+		if (!s) {
+			fprintf(stderr, "Couldn't create surface: %s\n",
+				SDL_GetError());
+			return EXIT_FAILURE;
+		}
+
+		for (int i = 0; i < BENCH_HEIGHT; i++)
+			colors[i] = SDL_MapRGB(s->format, i, 255 - i, i/2);
+
+		printf("%4d", depths[d]);
+
+		for (int op = 0; op < BENCH_OPS; op++) {
+			double	start = Now(), elapsed;
+			Uint32	ops = 0;
+			double	pixels = 0;
+
+			do
+				for (int i = 0; i < 64; i++, ops++)
+					pixels += Run(s, op, ops);
+			while ((elapsed = Now() - start) < BENCH_TIME);
+
+			printf(" %12.0f %6.0f", ops/elapsed*1000.,
+			       pixels/elapsed/1000.);
+		}
+		printf("\n");
+
+		SDL_FreeSurface(s);
+	}
+
+	printf("\n%6s %14s %14s\n", "text", "16bpp glyphs/s", "32bpp glyphs/s");
+
+	graphics_config.glyph_cache = 0;
+
+	for (enum Graphics_SIMD level = GRAPHICS_SIMD_NONE; level <= simd; level++) {
+		const char *name = GRAPHICS_SIMD;
+
+		for (int i = 0; i < level; i++)
+			name += strlen(name) + 1;
+
+		Graphics_Init(level);
+		printf("%6s %14.0f %14.0f\n", name, Glyphs(16), Glyphs(32));
+	}
+
+	graphics_config.glyph_cache = 1;
+	printf("%6s %14.0f %14.0f\n", "cache", Glyphs(16), Glyphs(32));
+
+	Graphics_FreeGlyphCache();
+
+	return EXIT_SUCCESS;
+}
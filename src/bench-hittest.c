@@ -0,0 +1,157 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include <SDL.h>
+
+#include "controls.h"
+#include "hittest.h"
+
+/*
+ * microbenchmark of touch-down hit testing: lookups per second of the
+ * spatial grid versus a linear scan of the controls for increasing numbers
+ * of controls laid out on a 1920x1080 panel.
+ * every lookup result of the grid is checked against the linear scan.
+ */
+
+#define BENCH_WIDTH	1920
+#define BENCH_HEIGHT	1080
+#define BENCH_POINTS	4096	/* random touch-down points */
+#define BENCH_TIME	250	/* ms per measurement */
+
+static struct Control *
+LinearLookup(struct Control *controls, Uint32 cControls, Uint16 x, Uint16 y)
+{
+	for (struct Control *c = controls; c < controls + cControls; c++)
+		if (HitTest_Control(c, x, y))
+			return c;
+
+	return NULL;
+}
+
+static inline double
+Now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec*1000. + tv.tv_usec/1000.;
+}
+
+static struct Control *
+Layout(Uint32 cControls)
+{
+	struct Control	*controls = calloc(cControls, sizeof(struct Control));
+	Uint32		cols = ceil(sqrt(cControls*BENCH_WIDTH/BENCH_HEIGHT));
+	Uint32		rows = (cControls + cols - 1)/cols;
+
+	if (!controls)
+		return NULL;
+
+	for (Uint32 i = 0; i < cControls; i++) {
+		struct Control	*c = controls + i;
+		struct Slider	*slider = &c->u.slider;
+
+		c->geo.x = i % cols * BENCH_WIDTH/cols + 1;
+		c->geo.y = i/cols * BENCH_HEIGHT/rows + 1;
+		c->geo.w = BENCH_WIDTH/cols > 3 ? BENCH_WIDTH/cols - 3 : 1;
+		c->geo.h = BENCH_HEIGHT/rows > 3 ? BENCH_HEIGHT/rows - 3 : 1;
+
+		switch (i % 4) {
+		case 0:
+		case 1:
+			slider->type = SLIDER_BUTTON;
+			break;
+		case 2:
+			slider->type = SLIDER_SET;
+			break;
+		case 3:
+			c->type = FIELD;
+			continue;
+		}
+
+		slider->max = 1.;
+		Controls_SetSliderValue(slider, rand()/(double)RAND_MAX);
+		if (slider->type == SLIDER_BUTTON)
+			Controls_InitSliderButton(c);
+	}
+
+	return controls;
+}
+
+int
+main(int argc, char **argv)
+{
+	static const Uint32 sizes[] = {10, 100, 1000, 10000};
+
+	printf("%8s %8s %14s %14s %8s\n",
+	       "controls", "cell", "linear/s", "grid/s", "hits");
+
+	for (Uint32 s = argc > 1 ? sizeof(sizes)/sizeof(*sizes) - 1 : 0;
+	     s < sizeof(sizes)/sizeof(*sizes); s++) {
+		Uint32			cControls = argc > 1 ? strtoul(argv[1], NULL, 0)
+							     : sizes[s];
+		struct Control		*controls = Layout(cControls);
+		struct HitTest_Grid	grid;
+
+		Uint16			points[BENCH_POINTS][2];
+		Uint32			hits = 0, lookups;
+		volatile Uint32		found = 0;
+		double			start, elapsed, linear;
+
+		memset(&grid, 0, sizeof(struct HitTest_Grid));
+		if (!controls ||
+		    HitTest_BuildGrid(&grid, controls, cControls)) {
+			fprintf(stderr, "Out of memory\n");
+			return EXIT_FAILURE;
+		}
+
+		for (Uint32 i = 0; i < BENCH_POINTS; i++) {
+			struct Control *c;
+
+			points[i][0] = rand() % BENCH_WIDTH;
+			points[i][1] = rand() % BENCH_HEIGHT;
+
+			c = LinearLookup(controls, cControls,
+					 points[i][0], points[i][1]);
+			if (HitTest_Lookup(&grid, points[i][0], points[i][1]) != c) {
+				fprintf(stderr, "Grid lookup mismatch at %u,%u\n",
+					points[i][0], points[i][1]);
+				return EXIT_FAILURE;
+			}
+			hits += c != NULL;
+		}
+
+		start = Now();
+		lookups = 0;
+		do
+			for (Uint32 i = 0; i < BENCH_POINTS; i++, lookups++)
+				found += LinearLookup(controls, cControls,
+						      points[i][0], points[i][1]) != NULL;
+		while ((elapsed = Now() - start) < BENCH_TIME);
+		linear = lookups/elapsed*1000.;
+
+		start = Now();
+		lookups = 0;
+		do
+			for (Uint32 i = 0; i < BENCH_POINTS; i++, lookups++)
+				found += HitTest_Lookup(&grid, points[i][0],
+							points[i][1]) != NULL;
+		while ((elapsed = Now() - start) < BENCH_TIME);
+
+		printf("%8u %8u %14.0f %14.0f %7.1f%%\n",
+		       cControls, 1U << grid.shift, linear,
+		       lookups/elapsed*1000., hits*100./BENCH_POINTS);
+
+		HitTest_FreeGrid(&grid);
+		free(controls);
+	}
+
+	return EXIT_SUCCESS;
+}
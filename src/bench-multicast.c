@@ -0,0 +1,290 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <SDL.h>
+#include <SDL_thread.h>
+
+#include "osc.h"
+#include "latency.h"
+
+/*
+ * local multicast delivery check: subscribes a number of receivers to a
+ * group on the loopback interface, sends messages to the group through the
+ * OSC sending thread and reports the send rate and the share of messages
+ * every receiver got. fails if any message was lost.
+ * the sender stays at most BENCH_WINDOW messages ahead of the slowest
+ * receiver, so the delivery rate is measured without overrunning the
+ * receivers' socket buffers.
+ */
+
+#define BENCH_GROUP	"239.255.77.77"
+#define BENCH_PORT	47777
+#define BENCH_IFACE	"127.0.0.1"
+#define BENCH_RECEIVERS	3
+#define BENCH_MESSAGES	10000
+
+#define BENCH_MAX_RECEIVERS 64
+#define BENCH_WINDOW	128	/* max. messages sent ahead of receivers */
+#define BENCH_IDLE	1	/* s without datagrams until receiving ends */
+
+static struct Bench_Receiver {
+	int		fd;
+	volatile Uint32	received;
+} receivers[BENCH_MAX_RECEIVERS];
+static int cReceivers = BENCH_RECEIVERS;
+
+static double last_receive = 0;
+
+static inline double
+Now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec*1000. + tv.tv_usec/1000.;
+}
+
+/*
+ * messages received by the slowest receiver
+ */
+
+static inline Uint32
+Received(void)
+{
+	Uint32 min = receivers[0].received;
+
+	for (int r = 1; r < cReceivers; r++)
+		if (receivers[r].received < min)
+			min = receivers[r].received;
+
+	return min;
+}
+
+static int
+Subscribe(const char *group, int port, const char *iface)
+{
+	struct sockaddr_in	addr;
+	struct ip_mreq		mreq;
+	int			fd;
+	int			reuse = 1;
+
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(struct sockaddr_in));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+
+	mreq.imr_multiaddr.s_addr = inet_addr(group);
+	mreq.imr_interface.s_addr = inet_addr(iface);
+
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) ||
+	    bind(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_in)) < 0 ||
+	    setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq))) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ * counts the datagrams of all receivers until they are idle
+ */
+
+static int SDLCALL
+Receive(void *ud __attribute__((unused)))
+{
+	static char buffer[2048];
+
+	for (;;) {
+		fd_set	rdset;
+		int	max = 0;
+
+		struct timeval timeout = {
+			.tv_sec = BENCH_IDLE,
+			.tv_usec = 0
+		};
+
+		FD_ZERO(&rdset);
+		for (int r = 0; r < cReceivers; r++) {
+			FD_SET(receivers[r].fd, &rdset);
+			if (receivers[r].fd > max)
+				max = receivers[r].fd;
+		}
+
+		switch (select(max + 1, &rdset, NULL, NULL, &timeout)) {
+		case -1:
+			if (errno == EINTR)
+				continue;
+			return 1;
+
+		case 0:
+			return 0;
+		}
+
+		for (int r = 0; r < cReceivers; r++)
+			if (FD_ISSET(receivers[r].fd, &rdset))
+				while (recv(receivers[r].fd, buffer,
+					    sizeof(buffer), MSG_DONTWAIT) > 0)
+					receivers[r].received++;
+
+		last_receive = Now();
+	}
+}
+
+static void
+Usage(const char *name)
+{
+	printf("Usage: %s [-h] [-g GROUP] [-p PORT] [-I ADDRESS] "
+	       "[-r RECEIVERS] [-n MESSAGES]\n"
+	       "\t-h\t\tShow this help\n"
+	       "\t-g GROUP\tMulticast group (default: %s)\n"
+	       "\t-p PORT\t\tPort (default: %d)\n"
+	       "\t-I ADDRESS\tInterface address (default: %s)\n"
+	       "\t-r RECEIVERS\tNumber of receivers (default: %d, max. %d)\n"
+	       "\t-n MESSAGES\tNumber of messages (default: %d)\n",
+	       name, BENCH_GROUP, BENCH_PORT, BENCH_IFACE,
+	       BENCH_RECEIVERS, BENCH_MAX_RECEIVERS, BENCH_MESSAGES);
+}
+
+int
+main(int argc, char **argv)
+{
+	char			*group = BENCH_GROUP;
+	int			port = BENCH_PORT;
+	char			*iface = BENCH_IFACE;
+	Uint32			messages = BENCH_MESSAGES;
+
+	char			destination[64];
+	struct Osc_Template	tmpl = {.data = NULL};
+	struct Osc_Stats	stats;
+
+	SDL_Thread		*thread = NULL;
+	int			opt, status = EXIT_FAILURE;
+	double			start, sent;
+
+	while ((opt = getopt(argc, argv, "hg:p:I:r:n:")) != -1)
+		switch (opt) {
+		case 'g':
+			group = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'I':
+			iface = optarg;
+			break;
+		case 'r':
+			cReceivers = atoi(optarg);
+			break;
+		case 'n':
+			messages = strtoul(optarg, NULL, 10);
+			break;
+		case 'h':
+			Usage(*argv);
+			return EXIT_SUCCESS;
+		default:
+			Usage(*argv);
+			return EXIT_FAILURE;
+		}
+
+	if (cReceivers < 1 || cReceivers > BENCH_MAX_RECEIVERS) {
+		Usage(*argv);
+		return EXIT_FAILURE;
+	}
+
+	for (int r = 0; r < cReceivers; r++)
+		if ((receivers[r].fd = Subscribe(group, port, iface)) < 0) {
+			perror("Couldn't subscribe receiver");
+			cReceivers = r;
+			goto err;
+		}
+
+	/* stay on this host */
+	osc_config.multicast_ttl = 0;
+	osc_config.multicast_loop = 1;
+	osc_config.multicast_if = iface;
+
+	snprintf(destination, sizeof(destination), "%s:%d", group, port);
+	if (Osc_InitTemplate(&tmpl, "/bench/multicast", OSC_INT) ||
+	    Osc_AddDestinations(destination, "")) {
+		fprintf(stderr, "Couldn't connect to %s.\n", destination);
+		goto err;
+	}
+
+	if (!(thread = SDL_CreateThread(Receive, NULL))) {
+		fprintf(stderr, "Couldn't create receiving thread.\n");
+		goto err;
+	}
+
+	start = Now();
+	for (Uint32 i = 0; i < messages; i++) {
+		/* don't overrun the receivers' socket buffers */
+		while (i - Received() > BENCH_WINDOW)
+			SDL_Delay(0);
+
+		Latency_Input = Latency_Now();
+		if (Osc_EnqueueMessage(&tmpl, i)) {
+			fprintf(stderr, "Couldn't enqueue message.\n");
+			goto err;
+		}
+	}
+	while (Osc_QueueDepth())
+		SDL_Delay(1);
+	sent = Now();
+
+	SDL_WaitThread(thread, &opt);
+	thread = NULL;
+	if (opt) {
+		fprintf(stderr, "Receiving failed.\n");
+		goto err;
+	}
+
+	Osc_SumStats(&stats);
+
+	printf("%s, %d receivers, %u messages\n",
+	       destination, cReceivers, messages);
+	printf("%10s %12.0f msg/s %10u datagrams %10u calls\n", "sent",
+	       messages/(sent - start)*1000., stats.datagrams, stats.syscalls);
+
+	status = EXIT_SUCCESS;
+	for (int r = 0; r < cReceivers; r++) {
+		printf("%8s%2d %12.0f msg/s %10u received %9.2f %%\n",
+		       "receiver", r,
+		       receivers[r].received/(last_receive - start)*1000.,
+		       receivers[r].received,
+		       receivers[r].received*100./messages);
+
+		if (receivers[r].received != messages)
+			status = EXIT_FAILURE;
+	}
+
+	if (status != EXIT_SUCCESS)
+		fprintf(stderr, "Messages were lost.\n");
+
+err:
+
+	if (thread)
+		SDL_WaitThread(thread, NULL);
+	Osc_TerminateThreads();
+	free(tmpl.data);
+	for (int r = 0; r < cReceivers; r++)
+		close(receivers[r].fd);
+
+	return status;
+}
@@ -0,0 +1,345 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <SDL.h>
+
+#include "controller.h"
+#include "controls.h"
+#include "graphics.h"
+#include "xml.h"
+
+/*
+ * headless rendering benchmark: loads an interface and draws scripted,
+ * deterministic value changes of all controls of its tabs on the screen of
+ * SDL's dummy video driver (a plain memory surface).
+ * reports frames per second, the mean time per kind of redraw and per
+ * drawing primitive (graphics.c is compiled with GRAPHICS_PROFILE) and a
+ * checksum of the final screen. before switching to the next tab and at the
+ * end, the screen is verified against a complete redraw of the tab.
+ */
+
+struct Display display = {
+	.width = 800,
+	.height = 600,
+	.bpp = 32,
+	.flags = SDL_SWSURFACE
+};
+struct Registry registry;
+
+#define BENCH_FRAMES	2000
+#define BENCH_TAB	500	/* frames per tab */
+#define BENCH_TOGGLE	8	/* frames per field toggle */
+
+enum Bench_Draw {
+	BENCH_SLIDER = 0,
+	BENCH_FIELD,
+	BENCH_FLUSH,
+	BENCH_FULL,
+	BENCH_DRAWS
+};
+
+static const char *names[BENCH_DRAWS] = {
+	"slider", "field", "flush", "full"
+};
+
+static struct Bench_Timing {
+	double	ms;
+	Uint32	count;
+} timings[BENCH_DRAWS];
+
+static double verifying = 0;	/* ms, not benchmarked */
+
+static Uint32 seed = 1;
+
+static inline double
+Now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec*1000. + tv.tv_usec/1000.;
+}
+
+/* xorshift32, so runs are reproducible on every libc */
+static inline Uint32
+Random(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+
+	return seed;
+}
+
+static inline void
+Account(enum Bench_Draw draw, double start)
+{
+	timings[draw].ms += Now() - start;
+	timings[draw].count++;
+}
+
+/*
+ * FNV-1a over the visible pixels
+ */
+
+static Uint32
+Checksum(SDL_Surface *s)
+{
+	Uint32 hash = 2166136261u;
+
+	if (SDL_LockSurface(s))
+		return 0;
+
+	for (int y = 0; y < s->h; y++) {
+		const Uint8 *p = (Uint8 *)s->pixels + y*s->pitch;
+
+		for (int x = s->w*s->format->BytesPerPixel; x; x--, p++)
+			hash = (hash ^ *p)*16777619u;
+	}
+
+	SDL_UnlockSurface(s);
+	return hash;
+}
+
+static int
+DrawTab(SDL_Surface *s, struct Tab *tab)
+{
+	if (Graphics_BlankRect(s, NULL))
+		return 1;
+	Graphics_Damage(s, NULL);
+
+	for (struct Control *c = tab->controls;
+	     c < tab->controls + tab->cControls; c++) {
+		Controls_Invalidate(c);
+		if (Controls_Draw(s, c))
+			return 1;
+	}
+
+	Graphics_Flush(s);
+
+	return 0;
+}
+
+/*
+ * incremental drawing must equal a complete redraw (which is excluded from
+ * all timings and statistics), returns -1 on errors
+ */
+
+static int
+Verify(SDL_Surface *s, SDL_Surface *incremental, struct Tab *tab)
+{
+	struct Graphics_Stats	stats = Graphics_Stats;
+	double			start = Now();
+	int			r = 0;
+
+	if (SDL_BlitSurface(s, NULL, incremental, NULL) || DrawTab(s, tab) ||
+	    SDL_LockSurface(s))
+		return -1;
+	if (SDL_LockSurface(incremental)) {
+		SDL_UnlockSurface(s);
+		return -1;
+	}
+
+	for (int y = 0; y < s->h && !r; y++)
+		if (memcmp((Uint8 *)s->pixels + y*s->pitch,
+			   (Uint8 *)incremental->pixels + y*incremental->pitch,
+			   s->w*s->format->BytesPerPixel)) {
+			fprintf(stderr, "Incremental drawing of tab \"%s\" "
+					"differs from a complete redraw in "
+					"line %d.\n", tab->label, y);
+			r = 1;
+		}
+
+	SDL_UnlockSurface(incremental);
+	SDL_UnlockSurface(s);
+
+	Graphics_Stats = stats;
+	verifying += Now() - start;
+
+	return r;
+}
+
+/*
+ * sliders move by up to 1/8 of their range per frame, like dragged ones
+ */
+
+static int
+Frame(SDL_Surface *s, struct Tab *tab, Uint32 frame)
+{
+	double start;
+
+	for (struct Control *c = tab->controls;
+	     c < tab->controls + tab->cControls; c++) {
+		switch (c->type) {
+		case SLIDER: {
+			struct Slider	*slider = &c->u.slider;
+			double		range = slider->max - slider->min;
+
+			Controls_SetValue(c, slider->value +
+					     ((double)(Random() % 257) - 128.)/
+					     1024.*range);
+			break;
+		}
+
+		case FIELD:
+			if (frame % BENCH_TOGGLE)
+				continue;
+			Controls_SetValue(c, !c->u.field.value);
+			break;
+		}
+
+		start = Now();
+		if (Controls_Draw(s, c))
+			return 1;
+		Account(c->type == SLIDER ? BENCH_SLIDER : BENCH_FIELD, start);
+	}
+
+	start = Now();
+	Graphics_Flush(s);
+	Account(BENCH_FLUSH, start);
+
+	return 0;
+}
+
+static void
+Usage(const char *name)
+{
+	printf("Usage: %s [-h] [-W WIDTH] [-H HEIGHT] [-b BPP] [-n FRAMES] [-c] "
+	       "INTERFACE\n"
+	       "\t-h\t\tShow this help\n"
+	       "\t-W WIDTH\tScreen width (default: %d)\n"
+	       "\t-H HEIGHT\tScreen height (default: %d)\n"
+	       "\t-b BPP\t\tColor depth (default: %d)\n"
+	       "\t-n FRAMES\tNumber of frames (default: %d)\n"
+	       "\t-c\t\tDisable glyph cache\n",
+	       name, display.width, display.height, display.bpp, BENCH_FRAMES);
+}
+
+int
+main(int argc, char **argv)
+{
+	SDL_Surface	*s;
+	SDL_Surface	*incremental = NULL;
+	struct Tab	*tab = NULL;
+
+	Uint32		frames = BENCH_FRAMES;
+	Uint32		checksum;
+	double		start, elapsed;
+	int		opt;
+
+	while ((opt = getopt(argc, argv, "hW:H:b:n:c")) != -1)
+		switch (opt) {
+		case 'W':
+			display.width = atoi(optarg);
+			break;
+		case 'H':
+			display.height = atoi(optarg);
+			break;
+		case 'b':
+			display.bpp = atoi(optarg);
+			break;
+		case 'n':
+			frames = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			graphics_config.glyph_cache = 0;
+			break;
+		case 'h':
+			Usage(*argv);
+			return EXIT_SUCCESS;
+		default:
+			Usage(*argv);
+			return EXIT_FAILURE;
+		}
+
+	if (optind != argc - 1) {
+		Usage(*argv);
+		return EXIT_FAILURE;
+	}
+
+	if (!getenv("SDL_VIDEODRIVER"))
+		putenv("SDL_VIDEODRIVER=dummy");
+
+	if (SDL_Init(SDL_INIT_VIDEO) ||
+	    !(s = SDL_SetVideoMode(display.width, display.height,
+				   display.bpp, display.flags))) {
+		fprintf(stderr, "Couldn't set video mode: %s\n", SDL_GetError());
+		return EXIT_FAILURE;
+	}
+
+	Graphics_Init(GRAPHICS_SIMD_AVX2);
+
+	display.foreground = SDL_MapRGB(s->format, 0, 255, 0);
+	display.background = SDL_MapRGB(s->format, 0, 0, 0);
+
+	if (Xml_ReadInterface(argv[optind], s)) {
+		fprintf(stderr, "Error parsing interface definition.\n");
+		SDL_Quit();
+		return EXIT_FAILURE;
+	}
+
+	if (!(incremental = SDL_ConvertSurface(s, s->format, SDL_SWSURFACE)))
+		goto err;
+
+	start = Now();
+
+	for (Uint32 frame = 0; frame < frames; frame++) {
+		if (!(frame % BENCH_TAB)) {
+			double draw;
+
+			if (tab && Verify(s, incremental, tab))
+				goto err;
+
+			tab = registry.tabs + frame/BENCH_TAB % registry.cTabs;
+
+			draw = Now();
+			if (DrawTab(s, tab))
+				goto err;
+			Account(BENCH_FULL, draw);
+		}
+
+		if (Frame(s, tab, frame))
+			goto err;
+	}
+
+	elapsed = Now() - start - verifying;
+	checksum = Checksum(s);
+
+	printf("%s: %dx%dx%d, %u frames, %u tabs\n", argv[optind],
+	       s->w, s->h, s->format->BitsPerPixel, frames, registry.cTabs);
+	printf("%10s %12.1f\n", "frames/s", frames/elapsed*1000.);
+	for (int draw = 0; draw < BENCH_DRAWS; draw++)
+		printf("%10s %12.2f us %10u calls\n", names[draw],
+		       timings[draw].count ?
+		       timings[draw].ms*1000./timings[draw].count : 0.,
+		       timings[draw].count);
+	printf("%10s     %08X\n", "checksum", checksum);
+	Graphics_DumpStats(stdout);
+
+	if (tab && Verify(s, incremental, tab))
+		goto err;
+
+	SDL_FreeSurface(incremental);
+
+	Graphics_FreeGlyphCache();
+	SDL_Quit();
+
+	return EXIT_SUCCESS;
+
+err:
+
+	fprintf(stderr, "Rendering failed.\n");
+	if (incremental)
+		SDL_FreeSurface(incremental);
+	Graphics_FreeGlyphCache();
+	SDL_Quit();
+
+	return EXIT_FAILURE;
+}
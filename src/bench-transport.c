@@ -0,0 +1,393 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <SDL.h>
+#include <SDL_thread.h>
+
+#include "osc.h"
+#include "latency.h"
+#ifdef HAVE_SHM_OPEN
+#include "ring.h"
+#endif
+
+/*
+ * compares the transports for receivers on the same host: sends messages
+ * through the OSC sending thread to a loopback UDP socket and to a Unix
+ * domain datagram socket and reports the messages per second (with at most
+ * BENCH_WINDOW messages in flight) and the latency of single messages from
+ * enqueuing to receiving. every message carries its enqueue time (s.a.
+ * Latency_Now()).
+ * the shared memory ring is read directly (s.a. ring-forward.c), waiting on
+ * its futex.
+ * every transport is measured in a child process, since destinations
+ * cannot be removed.
+ */
+
+#define BENCH_PORT	47778
+#define BENCH_MESSAGES	100000
+#define BENCH_SAMPLES	10000	/* single messages */
+
+#define BENCH_WINDOW	128	/* max. messages sent ahead of the receiver */
+#define BENCH_TIMEOUT	1000	/* ms to wait for a lost message */
+
+enum Bench_Transport {
+	BENCH_UDP = 0,
+	BENCH_UNIX,
+	BENCH_SHM,
+	BENCH_TRANSPORTS
+};
+
+static const char *names[BENCH_TRANSPORTS] = {
+	"udp", "unix", "shm"
+};
+
+static volatile Uint32	received = 0;
+static Uint32		*latencies;	/* us, per received message */
+static volatile int	terminate = 0;
+
+static inline double
+Now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec*1000. + tv.tv_usec/1000.;
+}
+
+static int
+Listen(enum Bench_Transport transport, const char *path)
+{
+	int fd;
+
+	struct timeval timeout = {
+		.tv_sec = 0,
+		.tv_usec = 100000	/* to check for termination */
+	};
+
+	if (transport == BENCH_UNIX) {
+		struct sockaddr_un addr;
+
+		if ((fd = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0)
+			return -1;
+
+		memset(&addr, 0, sizeof(struct sockaddr_un));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+		unlink(path);
+		if (bind(fd, (struct sockaddr*)&addr,
+			 sizeof(struct sockaddr_un)) < 0)
+			goto err;
+	} else {
+		struct sockaddr_in addr;
+
+		if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+			return -1;
+
+		memset(&addr, 0, sizeof(struct sockaddr_in));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(BENCH_PORT);
+
+		if (bind(fd, (struct sockaddr*)&addr,
+			 sizeof(struct sockaddr_in)) < 0)
+			goto err;
+	}
+
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+		       sizeof(struct timeval)))
+		goto err;
+
+	return fd;
+
+err:
+	close(fd);
+	return -1;
+}
+
+/*
+ * records the latency of a message, its argument is the enqueue time as OSC
+ * double
+ */
+
+static inline void
+Record(const char *data, Uint32 size, Uint32 now)
+{
+	union {
+		double	d;
+		Uint64	i;
+	} arg;
+
+	if (size < 8)
+		return;
+
+	arg.i = (Uint64)ntohl(*(const Uint32 *)(data + size - 8)) << 32 |
+		ntohl(*(const Uint32 *)(data + size - 4));
+
+	latencies[received] = now - (Uint32)arg.d;
+	received++;
+}
+
+static int SDLCALL
+Receive(void *ud)
+{
+	static char buffer[2048];
+	int fd = *(int *)ud;
+
+	while (!terminate) {
+		ssize_t r = recv(fd, buffer, sizeof(buffer), 0);
+
+		if (r < 0) {
+			if (errno == EINTR || errno == EAGAIN ||
+			    errno == EWOULDBLOCK)
+				continue;
+			return 1;
+		}
+
+		Record(buffer, r, Latency_Now());
+	}
+
+	return 0;
+}
+
+#ifdef HAVE_SHM_OPEN
+static int SDLCALL
+ReceiveRing(void *ud)
+{
+	struct Ring *ring = ud;
+
+	while (!terminate) {
+		const char	*data;
+		uint32_t	size;
+
+		/* the timeout is to check for termination */
+		if (Ring_Wait(ring, 100) < 0)
+			return 1;
+
+		while ((data = Ring_Peek(ring, &size))) {
+			Record(data, size, Latency_Now());
+			Ring_Release(ring);
+		}
+	}
+
+	return 0;
+}
+#endif
+
+/*
+ * wait until the receiver got the given number of messages or lost one
+ */
+
+static inline void
+Wait(Uint32 count)
+{
+	double timeout = Now() + BENCH_TIMEOUT;
+
+	while (received < count && Now() < timeout)
+		SDL_Delay(0);
+}
+
+static int
+CompareUint32(const void *a, const void *b)
+{
+	Uint32 x = *(const Uint32 *)a, y = *(const Uint32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int
+Run(enum Bench_Transport transport, Uint32 messages, Uint32 samples)
+{
+	char			path[64], destination[80];
+	struct Osc_Template	tmpl = {.data = NULL};
+	SDL_Thread		*thread = NULL;
+	int			fd = -1, status = 1;
+#ifdef HAVE_SHM_OPEN
+	struct Ring		*ring = NULL;
+#endif
+
+	double			start, elapsed, mean = 0;
+	Uint32			sent, lost;
+	Uint32			*single;
+
+	snprintf(path, sizeof(path), "/tmp/bench-transport.%d",
+		 (int)getpid());
+
+	if (!(latencies = malloc((messages + samples)*sizeof(Uint32))))
+		return 1;
+	if (transport != BENCH_SHM && (fd = Listen(transport, path)) < 0) {
+		perror("Couldn't create receiving socket");
+		free(latencies);
+		return 1;
+	}
+
+	if (transport == BENCH_SHM)
+		snprintf(destination, sizeof(destination),
+			 OSC_SHM_PREFIX "bench-transport.%d", (int)getpid());
+	else if (transport == BENCH_UNIX)
+		snprintf(destination, sizeof(destination),
+			 OSC_UNIX_PREFIX "%s", path);
+	else
+		snprintf(destination, sizeof(destination),
+			 "127.0.0.1:%d", BENCH_PORT);
+
+	if (Osc_InitTemplate(&tmpl, "/bench/transport", OSC_DOUBLE) ||
+	    Osc_AddDestinations(destination, "")) {
+		fprintf(stderr, "Couldn't connect to %s.\n", destination);
+		goto err;
+	}
+
+	if (transport == BENCH_SHM) {
+#ifdef HAVE_SHM_OPEN
+		if (!(ring = Ring_Open(destination +
+				       sizeof(OSC_SHM_PREFIX) - 1))) {
+			perror("Couldn't open ring");
+			goto err;
+		}
+		thread = SDL_CreateThread(ReceiveRing, ring);
+#endif
+	} else
+		thread = SDL_CreateThread(Receive, &fd);
+	if (!thread) {
+		fprintf(stderr, "Couldn't create receiving thread.\n");
+		goto err;
+	}
+
+	start = Now();
+	for (sent = 0; sent < messages; sent++) {
+		/* don't overrun the receiver's socket buffer */
+		while (sent - received > BENCH_WINDOW)
+			SDL_Delay(0);
+
+		Latency_Input = Latency_Now();
+		if (Osc_EnqueueMessage(&tmpl, Latency_Input))
+			goto err;
+	}
+	Wait(messages);
+	elapsed = Now() - start;
+	lost = messages - received;
+
+	single = latencies + received;
+	for (Uint32 i = 0; i < samples; i++) {
+		Uint32 count = received + 1;
+
+		Latency_Input = Latency_Now();
+		if (Osc_EnqueueMessage(&tmpl, Latency_Input))
+			goto err;
+		Wait(count);
+	}
+	samples = latencies + received - single;
+
+	if (samples) {
+		for (Uint32 i = 0; i < samples; i++)
+			mean += single[i];
+		mean /= samples;
+
+		qsort(single, samples, sizeof(Uint32), CompareUint32);
+	}
+
+	printf("%-8s %12.0f %8u %10.1f %8u %8u %8u\n", names[transport],
+	       (messages - lost)/elapsed*1000., lost, mean,
+	       samples ? single[samples/2] : 0,
+	       samples ? single[samples*99/100] : 0,
+	       samples ? single[samples - 1] : 0);
+	status = 0;
+
+err:
+
+	terminate = 1;
+	if (thread)
+		SDL_WaitThread(thread, NULL);
+	Osc_TerminateThreads();
+#ifdef HAVE_SHM_OPEN
+	if (ring)
+		Ring_Close(ring);
+#endif
+	free(tmpl.data);
+	free(latencies);
+	if (fd >= 0)
+		close(fd);
+	if (transport == BENCH_UNIX)
+		unlink(path);
+
+	return status;
+}
+
+static void
+Usage(const char *name)
+{
+	printf("Usage: %s [-h] [-n MESSAGES] [-s SAMPLES]\n"
+	       "\t-h\t\tShow this help\n"
+	       "\t-n MESSAGES\tNumber of messages (default: %d)\n"
+	       "\t-s SAMPLES\tNumber of single messages (default: %d)\n",
+	       name, BENCH_MESSAGES, BENCH_SAMPLES);
+}
+
+int
+main(int argc, char **argv)
+{
+	Uint32	messages = BENCH_MESSAGES;
+	Uint32	samples = BENCH_SAMPLES;
+	int	opt, status = EXIT_SUCCESS;
+
+	while ((opt = getopt(argc, argv, "hn:s:")) != -1)
+		switch (opt) {
+		case 'n':
+			messages = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			samples = strtoul(optarg, NULL, 10);
+			break;
+		case 'h':
+			Usage(*argv);
+			return EXIT_SUCCESS;
+		default:
+			Usage(*argv);
+			return EXIT_FAILURE;
+		}
+
+	printf("%-8s %12s %8s %10s %8s %8s %8s\n", "", "msg/s", "lost",
+	       "mean us", "p50", "p99", "max");
+	fflush(stdout);
+
+	for (int transport = 0; transport < BENCH_TRANSPORTS; transport++) {
+		pid_t	pid;
+		int	wstatus;
+
+#ifndef HAVE_SHM_OPEN
+		if (transport == BENCH_SHM)
+			continue;
+#endif
+
+		switch ((pid = fork())) {
+		case -1:
+			perror("fork");
+			return EXIT_FAILURE;
+
+		case 0:
+			status = Run(transport, messages, samples);
+			fflush(stdout);
+			_exit(status);
+		}
+
+		if (waitpid(pid, &wstatus, 0) < 0 ||
+		    !WIFEXITED(wstatus) || WEXITSTATUS(wstatus))
+			status = EXIT_FAILURE;
+	}
+
+	return status;
+}
@@ -0,0 +1,215 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <SDL.h>
+
+#include "controller.h"
+#include "controls.h"
+#include "graphics.h"
+
+/*
+ * verifies the reference repainting of sliders (only the rows changed
+ * since the last draw, s.a. Controls_Slider()): every slider type, plain
+ * and gradient paint and several geometries are drawn with random values
+ * at all pixel depths on the screen of SDL's dummy video driver, and after
+ * every value change the screen must equal a complete redraw of a copy of
+ * the slider (with its own retained surface) on a separate surface, so that
+ * errors accumulating over several reference repaints are caught as well.
+ */
+
+struct Display display;
+struct Registry registry;
+
+#define CHECK_WIDTH	320
+#define CHECK_HEIGHT	240
+#define CHECK_CHANGES	200	/* value changes per slider */
+
+static const int depths[] = {8, 16, 24, 32};
+
+static const SDL_Rect geometries[] = {
+	{.x = 10, .y = 10, .w = 40, .h = 200},
+	{.x = 60, .y = 20, .w = 100, .h = 150},
+	{.x = 170, .y = 5, .w = 25, .h = 60},		/* small padding */
+	{.x = 200, .y = 30, .w = 15, .h = 100},		/* no padding */
+	{.x = 220, .y = 40, .w = 90, .h = 190}
+};
+
+static const double steps[] = {0, 10, 7, 1};
+
+#define CHECK_TYPES	(SLIDER_RELATIVE + 1)
+#define CHECK_PAINTS	(PAINT_GRAD + 1)
+#define CHECK_GEOMETRIES (int)(sizeof(geometries)/sizeof(*geometries))
+#define CHECK_CASES	(CHECK_TYPES*CHECK_PAINTS*CHECK_GEOMETRIES* \
+			 (int)(sizeof(steps)/sizeof(*steps)))
+
+static Uint32 seed = 1;
+
+static inline double
+Random(void)
+{
+	seed = seed*1103515245 + 12345;
+	return (seed >> 8 & 0xFFFF)/65535.;
+}
+
+/*
+ * compare the referencely drawn screen with the reference
+ */
+
+static int
+Compare(SDL_Surface *s, SDL_Surface *reference)
+{
+	int r = 0;
+
+	if (SDL_LockSurface(s))
+		return -1;
+	if (SDL_LockSurface(reference)) {
+		SDL_UnlockSurface(s);
+		return -1;
+	}
+
+	for (int y = 0; y < s->h && !r; y++)
+		r = memcmp((Uint8 *)s->pixels + y*s->pitch,
+			   (Uint8 *)reference->pixels + y*reference->pitch,
+			   s->w*s->format->BytesPerPixel) != 0;
+
+	SDL_UnlockSurface(reference);
+	SDL_UnlockSurface(s);
+
+	return r;
+}
+
+static void
+FreeSlider(struct Control *c)
+{
+	struct Slider *slider = &c->u.slider;
+
+	if (slider->paint.type == PAINT_GRAD)
+		free(slider->paint.u.grad.colors);
+	SDL_FreeSurface(slider->retained.surface);
+}
+
+static int
+Check(SDL_Surface *s, SDL_Surface *reference, enum Slider_Type type,
+      enum Paint_Type paint, const SDL_Rect *geo, double step)
+{
+	struct Control	c, ref;
+	struct Slider	*slider = &c.u.slider;
+	int		r = 0;
+
+	memset(&c, 0, sizeof(struct Control));
+	c.type = SLIDER;
+	c.geo = *geo;
+
+	slider->type = type;
+	slider->min = 0;
+	slider->max = 100;
+	slider->step = step;
+
+	slider->paint.type = paint;
+	if (paint == PAINT_PLAIN) {
+		slider->paint.u.plain.color = SDL_MapRGB(s->format, 0, 255, 0);
+	} else {
+		slider->paint.u.grad.top = (SDL_Color){255, 0, 0, 0};
+		slider->paint.u.grad.bottom = (SDL_Color){0, 0, 255, 0};
+	}
+
+	/* the reference is always redrawn completely */
+	ref = c;
+
+	if (Graphics_BlankRect(s, NULL) || Graphics_BlankRect(reference, NULL))
+		return -1;
+	Controls_SetValue(&c, slider->max*Random());
+	if (Controls_Draw(s, &c))
+		r = -1;
+
+	for (int i = 0; i < CHECK_CHANGES && !r; i++) {
+		/* small moves like dragging and jumps like "set" clicks */
+		double value = i % 4 ? slider->value + (Random() - .5)*20
+				     : slider->max*Random();
+
+		Controls_SetValue(&c, value);
+		Controls_SetValue(&ref, value);
+		Controls_Invalidate(&ref);
+		if (Controls_Draw(s, &c) || Controls_Draw(reference, &ref))
+			r = -1;
+		else if ((r = Compare(s, reference)) > 0)
+			fprintf(stderr, "%dx%d+%d+%d slider (type %d, paint %d, "
+					"step %g) differs at %g after %d changes "
+					"in %d bit mode.\n",
+				geo->w, geo->h, geo->x, geo->y, type, paint,
+				step, slider->value, i + 1,
+				s->format->BitsPerPixel);
+	}
+
+	FreeSlider(&c);
+	FreeSlider(&ref);
+
+	return r;
+}
+
+int
+main(int argc, char **argv)
+{
+	int	checks = 0, failed = 0;
+
+	(void)argc;
+
+	if (!getenv("SDL_VIDEODRIVER"))
+		putenv("SDL_VIDEODRIVER=dummy");
+
+	if (SDL_Init(SDL_INIT_VIDEO)) {
+		fprintf(stderr, "%s: Couldn't initialize SDL: %s\n",
+			*argv, SDL_GetError());
+		return EXIT_FAILURE;
+	}
+
+	Graphics_Init(GRAPHICS_SIMD_AVX2);
+
+	for (size_t d = 0; d < sizeof(depths)/sizeof(*depths); d++) {
+		SDL_Surface *s, *reference;
+
+		if (!(s = SDL_SetVideoMode(CHECK_WIDTH, CHECK_HEIGHT, depths[d],
+					   SDL_SWSURFACE)) ||
+		    !(reference = SDL_ConvertSurface(s, s->format,
+						       SDL_SWSURFACE))) {
+			fprintf(stderr, "Couldn't set %d bit video mode: %s\n",
+				depths[d], SDL_GetError());
+			SDL_Quit();
+			return EXIT_FAILURE;
+		}
+
+		for (int k = 0; k < CHECK_CASES; k++) {
+			int r = Check(s, reference,
+				      k % CHECK_TYPES,
+				      k/CHECK_TYPES % CHECK_PAINTS,
+				      geometries + k/(CHECK_TYPES*CHECK_PAINTS) %
+						   CHECK_GEOMETRIES,
+				      steps[k/(CHECK_TYPES*CHECK_PAINTS*
+					       CHECK_GEOMETRIES)]);
+
+			if (r < 0) {
+				fprintf(stderr, "Drawing failed.\n");
+				SDL_FreeSurface(reference);
+				SDL_Quit();
+				return EXIT_FAILURE;
+			}
+
+			checks++;
+			failed += r;
+		}
+
+		SDL_FreeSurface(reference);
+	}
+
+	Graphics_FreeGlyphCache();
+	SDL_Quit();
+
+	printf("%d of %d slider checks failed.\n", failed, checks);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -15,6 +15,11 @@
 #include "controls.h"
 #include "xml.h"
 #include "osc.h"
+#include "feedback.h"
+#include "dispatch.h"
+#include "replay.h"
+#include "latency.h"
+#include "hud.h"
 #include "controller.h"
 
 #define DIE(MSG, ...) {					\
@@ -28,15 +33,23 @@ static inline int EnqueueAllControls(struct Tab *tab);
 
 static inline struct Control *GetControl(struct Tab *tab, Uint16 x, Uint16 y);
 
-static inline int UpdateSliderValue(SDL_Surface *s, struct Control *c,
+static inline int UpdateSliderValue(struct Control *c,
 				    SDL_MouseMotionEvent *motion);
+static inline int FoldMotionEvents(SDL_MouseMotionEvent *motion);
+static inline int ApplyFeedback(struct Tab *tab, struct Control *cur);
 
+static inline void MarkDirty(struct Control *c);
+static inline int DrawDirtyControls(SDL_Surface *s);
 static inline int DrawAllControls(SDL_Surface *s, struct Tab *tab);
+static inline int WaitEvent(SDL_Event *event);
+static inline int PollEventUntil(SDL_Event *event, Uint32 deadline);
 static void FreeRegistry(void);
 static inline int ToggleCursor(void);
 
 static inline int EvalOptions(int argc, char **argv, char **interface,
-			      char **host, int *port);
+			      char **host, char **port, int *dispatch,
+			      int *listen_port, char **group,
+			      char **record, char **replay);
 static void quit_wrapper(void);
 int main(int argc, char **argv);
 
@@ -47,36 +60,33 @@ struct Display display = {		/* initialize with default config */
 	.bpp = 16,
 
 	.flags = SDL_FULLSCREEN,
-	.cursor = SDL_DISABLE
+	.cursor = SDL_DISABLE,
+
+	.fps = 60
 };
 
 #define DEFAULT_FOREGROUND 0,	255,	0
 #define DEFAULT_BACKGROUND 0,	0,	0
 
 #define DEFAULT_HOST	"localhost"	/* default OSC server config */
-#define DEFAULT_PORT	77777
+#define DEFAULT_PORT	"77777"
 
 struct Registry registry = {
 	.tabs = NULL,
 	.cTabs = 0
 };
 
+static struct Control	**dirty = NULL;	/* controls to redraw in next frame */
+static Uint32		cDirty = 0;
+
 static int
 Slider_EnqueueMessage(struct Control *c)
 {
 	struct Control_OSC	*osc = &c->OSC;
 	struct Slider		*slider = &c->u.slider;
 
-	if (osc->address)
-		switch (osc->datatype) {
-		case OSC_INT:
-		case OSC_FLOAT:
-		case OSC_DOUBLE:
-		case OSC_BOOL:
-			return Osc_EnqueueFloatMessage(osc->address, slider->value);
-		}
-
-	return 0;
+	return osc->address ? Osc_UpdateMessage(&osc->template, slider->value)
+			    : 0;
 }
 
 static int
@@ -85,16 +95,8 @@ Field_EnqueueMessage(struct Control *c)
 	struct Control_OSC	*osc = &c->OSC;
 	struct Field		*field = &c->u.field;
 
-	if (osc->address)
-		switch (osc->datatype) {
-		case OSC_INT:
-		case OSC_FLOAT:
-		case OSC_DOUBLE:
-		case OSC_BOOL:
-			return Osc_EnqueueFloatMessage(osc->address, field->value);
-		}
-
-	return 0;
+	return osc->address ? Osc_EnqueueMessage(&osc->template, field->value)
+			    : 0;
 }
 
 static inline int
@@ -122,63 +124,15 @@ EnqueueAllControls(struct Tab *tab)
 static inline struct Control *
 GetControl(struct Tab *tab, Uint16 x, Uint16 y)
 {
-	struct Control *cur = tab->controls;
-
-	for (Uint32 c = tab->cControls; c; c--, cur++)
-		if (x >= cur->geo.x && x <= cur->geo.x + cur->geo.w)
-			switch (cur->type) {
-			case SLIDER:
-				switch (cur->u.slider.type) {
-				case SLIDER_SET:
-				case SLIDER_RELATIVE:
-					if (y >= cur->geo.y && y <= cur->geo.y + cur->geo.h)
-						return cur;
-					break;
-
-				case SLIDER_BUTTON: {
-					struct Slider_Button *button = &cur->u.slider.u.button;
-
-					if (y >= button->button_y && y <= button->button_y +
-					    (SLIDER_PADDING(cur) << 1))
-						return cur;
-					break;
-				}
-				}
-				break;
-
-			case FIELD:
-				if (y >= cur->geo.y && y <= cur->geo.y + cur->geo.h)
-					return cur;
-				break;
-			}
-
-	return NULL;
+	return HitTest_Lookup(&tab->grid, x, y);
 }
 
 static inline int
-UpdateSliderValue(SDL_Surface *s, struct Control *c,
-		  SDL_MouseMotionEvent *motion)
+UpdateSliderValue(struct Control *c, SDL_MouseMotionEvent *motion)
 {
 	struct Slider	*slider = &c->u.slider;
 	Uint16		padding = SLIDER_PADDING(c);
 
-	if (slider->show_value) {
-		SDL_Rect text;
-		int len = snprintf(NULL, 0, "%g/%g", slider->value, slider->max);
-
-		if (len == -1)
-			return 1;
-
-		text.x = c->geo.x;
-		text.y = c->geo.y + c->geo.h + 1;
-		text.w = len*FONTWIDTH;
-		text.h = FONTHEIGHT;
-
-		if (Graphics_BlankRect(s, &text))
-			return 1;
-		SDL_UpdateRects(s, 1, &text);
-	}
-
 	switch (slider->type) {
 	case SLIDER_SET:
 	case SLIDER_BUTTON:
@@ -224,18 +178,134 @@ UpdateSliderValue(SDL_Surface *s, struct Control *c,
 	return 0;
 }
 
+/*
+ * fold all queued motion events into the current one, so a burst of
+ * motions results in a single (net) value update.
+ * the folded events are recorded individually, returns nonzero if that fails
+ */
+
+static inline int
+FoldMotionEvents(SDL_MouseMotionEvent *motion)
+{
+	SDL_Event next;
+
+	SDL_PumpEvents();
+
+	while (SDL_PeepEvents(&next, 1, SDL_PEEKEVENT, SDL_ALLEVENTS) == 1 &&
+	       next.type == SDL_MOUSEMOTION &&
+	       SDL_PeepEvents(&next, 1, SDL_GETEVENT, SDL_MOUSEMOTIONMASK) == 1) {
+		if (Replay_Record(&next))
+			return 1;
+
+		motion->state = next.motion.state;
+		motion->x = next.motion.x;
+		motion->y = next.motion.y;
+		motion->xrel += next.motion.xrel;
+		motion->yrel += next.motion.yrel;
+	}
+
+	return 0;
+}
+
+/*
+ * apply values received from the application and queue the updated
+ * controls of the current tab for redraw. the control currently
+ * manipulated by the user is not updated.
+ */
+
+static inline int
+ApplyFeedback(struct Tab *tab, struct Control *cur)
+{
+	struct Control	**updated;
+	Uint32		count;
+
+	if (!(updated = Feedback_Apply(cur, &count)))
+		return 1;
+
+	for (; count; count--, updated++)
+		if (*updated >= tab->controls &&
+		    *updated < tab->controls + tab->cControls)
+			MarkDirty(*updated);
+
+	return 0;
+}
+
+static inline void
+MarkDirty(struct Control *c)
+{
+	if (!c->dirty) {
+		c->dirty = 1;
+		dirty[cDirty++] = c;
+	}
+}
+
+static inline int
+DrawDirtyControls(SDL_Surface *s)
+{
+	Uint32 start = Latency_Now();
+
+	for (; cDirty; cDirty--) {
+		struct Control *c = dirty[cDirty - 1];
+
+		c->dirty = 0;
+		if (Controls_Draw(s, c))
+			return 1;
+	}
+
+	Graphics_Flush(s);
+
+	Latency_Record(LATENCY_RENDER, Latency_Now() - start);
+	return 0;
+}
+
 static inline int
 DrawAllControls(SDL_Surface *s, struct Tab *tab)
 {
 	struct Control *cur = tab->controls;
 
-	for (Uint32 c = tab->cControls; c; c--, cur++)
+	for (Uint32 c = tab->cControls; c; c--, cur++) {
+		Controls_Invalidate(cur);
 		if (Controls_Draw(s, cur))
 			return 1;
+	}
 
 	return 0;
 }
 
+/*
+ * like SDL_WaitEvent(), which polls as well in SDL 1.2, but dumps the
+ * latency statistics on request while waiting
+ */
+
+static inline int
+WaitEvent(SDL_Event *event)
+{
+	while (!SDL_PollEvent(event)) {
+		if (Latency_DumpRequested())
+			Latency_Dump(stderr);
+		SDL_Delay(10);
+	}
+
+	return 1;
+}
+
+/*
+ * like SDL_PollEvent() but waits for an event until the deadline (in ticks)
+ * has passed; SDL 1.2 has no SDL_WaitEventTimeout()
+ */
+
+static inline int
+PollEventUntil(SDL_Event *event, Uint32 deadline)
+{
+	while (!SDL_PollEvent(event)) {
+		if ((Sint32)(SDL_GetTicks() - deadline) >= 0)
+			return 0;
+		SDL_Delay(1);
+	}
+
+	return 1;
+}
+
 /*
  * not that useful right now but might become handy later when we need to load
  * interface dynamically
@@ -244,15 +314,21 @@ DrawAllControls(SDL_Surface *s, struct Tab *tab)
 static void
 FreeRegistry(void)
 {
+	Dispatch_FreeIndex();
+
 	for (struct Tab *tab = registry.tabs; registry.cTabs;
 						registry.cTabs--, tab++) {
 		for (struct Control *control = tab->controls; tab->cControls;
 							tab->cControls--, control++) {
 			free(control->OSC.address);
+			free(control->OSC.template.data);
 
 			switch (control->type) {
 			case SLIDER:
 				free(control->u.slider.label);
+				if (control->u.slider.paint.type == PAINT_GRAD)
+					free(control->u.slider.paint.u.grad.colors);
+				SDL_FreeSurface(control->u.slider.retained.surface);
 				break;
 
 			case FIELD:
@@ -261,11 +337,13 @@ FreeRegistry(void)
 			}
 		}
 
+		HitTest_FreeGrid(&tab->grid);
 		free(tab->controls);
 		free(tab->label);
 	}
 
 	free(registry.tabs);
+	free(registry.destinations);
 	memset(&registry, 0, sizeof(struct Registry));
 }
 
@@ -277,12 +355,14 @@ ToggleCursor(void)
 }
 
 static inline int
-EvalOptions(int argc, char **argv, char **interface, char **host, int *port)
+EvalOptions(int argc, char **argv, char **interface, char **host, char **port,
+	    int *dispatch, int *listen_port, char **group, char **record,
+	    char **replay)
 {
 	int		c;
 	char		*p;
 
-	while ((c = getopt(argc, argv, "hg:b:fci:r:p:d")) != -1)
+	while ((c = getopt(argc, argv, "hg:b:fcF:i:r:p:m:nI:dlB:sL:G:e:R:t")) != -1)
 		switch (c) {
 		case '?':
 		case 'h':
@@ -298,9 +378,26 @@ EvalOptions(int argc, char **argv, char **interface, char **host, int *port)
 			       "\t\t-b BPP\t\t"		"Color depth\n"
 			       "\t\t-f\t\t"		"Toggle fullscreen mode\n"
 			       "\t\t-c\t\t"		"Toggle mouse cursor display\n"
-			       "\t\t-r HOST\t\t"	"Remote host (OSC server)\n"
-			       "\t\t-p PORT\t\t"	"Remote port\n"
-			       "\t\t-d\t\t"		"Disable OSC message dispatching\n\n",
+			       "\t\t-F FPS\t\t"		"Redraw at most FPS times per second\n"
+			       "\t\t\t\t"		"(0: unlimited)\n"
+			       "\t\t-r HOST[,...]\t"	"Remote hosts (OSC servers),\n"
+			       "\t\t\t\t"		"HOST[:PORT], unix:PATH or shm:NAME each\n"
+			       "\t\t-p PORT[,...]\t"	"Remote ports of the hosts\n"
+			       "\t\t-m TTL\t\t"	"Hops of multicast messages (default: 1)\n"
+			       "\t\t-n\t\t"		"Don't deliver multicast messages locally\n"
+			       "\t\t-I ADDRESS\t"	"Multicast interface address\n"
+			       "\t\t-d\t\t"		"Disable OSC message dispatching\n"
+			       "\t\t-l\t\t"		"Coalesce slider updates (latest value wins)\n"
+			       "\t\t-B DELAY\t"		"Send OSC bundles, waiting at most DELAY ms\n"
+			       "\t\t-s\t\t"		"Print OSC and redraw statistics on exit\n"
+			       "\t\t\t\t"		"(latency statistics are always printed)\n"
+			       "\t\t-L PORT\t\t"	"Receive OSC messages on PORT\n"
+			       "\t\t\t\t"		"(0: on the sending socket)\n"
+			       "\t\t-G GROUP\t"		"Receive messages of multicast GROUP\n"
+			       "\t\t-e FILE\t\t"	"Record input events to FILE\n"
+			       "\t\t-R FILE\t\t"	"Replay input events from FILE\n"
+			       "\t\t\t\t"		"(as fast as possible)\n"
+			       "\t\t-t\t\t"		"Replay with the recorded timing\n\n",
 			       p);
 
 			return 1;
@@ -327,6 +424,12 @@ EvalOptions(int argc, char **argv, char **interface, char **host, int *port)
 			ToggleCursor();
 			break;
 
+		case 'F':
+			display.fps = strtoul(optarg, &p, 10);
+			if (*p)
+				return 1;
+			break;
+
 		case 'i':
 			*interface = optarg;
 			break;
@@ -336,13 +439,62 @@ EvalOptions(int argc, char **argv, char **interface, char **host, int *port)
 			break;
 
 		case 'p':
-			*port = strtoul(optarg, &p, 10);
+			*port = optarg;
+			break;
+
+		case 'm':
+			osc_config.multicast_ttl = strtoul(optarg, &p, 10);
 			if (*p)
 				return 1;
 			break;
 
+		case 'n':
+			osc_config.multicast_loop = 0;
+			break;
+
+		case 'I':
+			osc_config.multicast_if = optarg;
+			break;
+
 		case 'd':
-			*host = NULL;
+			*dispatch = 0;
+			break;
+
+		case 'l':
+			osc_config.coalesce = 1;
+			break;
+
+		case 'B':
+			osc_config.bundle = 1;
+			osc_config.bundle_delay = strtoul(optarg, &p, 10);
+			if (*p)
+				return 1;
+			break;
+
+		case 's':
+			osc_config.stats = 1;
+			break;
+
+		case 'L':
+			*listen_port = strtoul(optarg, &p, 10);
+			if (*p)
+				return 1;
+			break;
+
+		case 'G':
+			*group = optarg;
+			break;
+
+		case 'e':
+			*record = optarg;
+			break;
+
+		case 'R':
+			*replay = optarg;
+			break;
+
+		case 't':
+			replay_config.realtime = 1;
 			break;
 		}
 
@@ -366,30 +518,34 @@ int main(int argc, char **argv)
 	struct Tab		*curTab;
 	struct Control		*cur = NULL;
 
+	Uint32			frame = 0;	/* ticks of next frame */
+
 	char			*interface = NULL;
-	char			*host = DEFAULT_HOST;	/* default config, s.a. */
-	int			port = DEFAULT_PORT;
+	char			*host = NULL;	/* default config, s.a. */
+	char			*port = DEFAULT_PORT;
+	int			dispatch = 1;
+
+	int			socket_fd = -1;	/* of first socket destination */
+
+	int			listen_port = -1;	/* no feedback */
+	int			listen_fd = -1;
+	char			*group = NULL;	/* multicast group to join */
+	SDL_Thread		*feedbackThread = NULL;
 
-	int			socket_fd = -1;
-	SDL_Thread		*oscThread = NULL;
+	char			*record = NULL;	/* input event file */
+	char			*replay = NULL;
+	SDL_Thread		*replayThread = NULL;
 
 	/* TODO: update global (display) default config by evaluating a
 	   config XML file */
 
-	if (EvalOptions(argc, argv, &interface, &host, &port))
+	if (EvalOptions(argc, argv, &interface, &host, &port, &dispatch,
+			&listen_port, &group, &record, &replay))
 		DIE("Error during command line option pasing.");
 
 	if (!interface)
 		DIE("You have to specify an interface definition (-i option).");
 
-	if (host) {
-		if ((socket_fd = Osc_Connect(host, port)) < 0)
-			DIE("Couldn't create and connect socket.");
-
-		if (!(oscThread = Osc_InitThread(&socket_fd)))
-			DIE("Error initializing the OSC sending thread.");
-	}
-
 	if (SDL_Init(SDL_INIT_VIDEO))
 		DIE("Couldn't initialize video subsystem.");
 
@@ -405,6 +561,8 @@ int main(int argc, char **argv)
 				   display.bpp, display.flags)))
 		DIE("Couldn't set video mode.");
 
+	Graphics_Init(GRAPHICS_SIMD_AVX2);
+
 				/* default config, s.a. */
 	display.foreground = SDL_MapRGB(s->format, DEFAULT_FOREGROUND);	
 	display.background = SDL_MapRGB(s->format, DEFAULT_BACKGROUND);
@@ -414,19 +572,104 @@ int main(int argc, char **argv)
 
 	curTab = registry.tabs;	/* first tab */
 
-	if (host && EnqueueAllControls(curTab))
+			/* command line destinations override the interface's */
+	if (dispatch) {
+		if (!host)
+			host = registry.destinations ? registry.destinations
+						    : DEFAULT_HOST;
+
+		if (Osc_AddDestinations(host, port))
+			DIE("Couldn't connect OSC destinations and initialize "
+			    "their sending threads.");
+		socket_fd = Osc_Socket();
+	}
+
+	for (struct Tab *tab = registry.tabs;
+	     tab < registry.tabs + registry.cTabs; tab++)
+		if (tab->cControls > cDirty)
+			cDirty = tab->cControls;
+	if (!(dirty = malloc((cDirty + 1)*sizeof(struct Control *))))
+		DIE("Couldn't allocate redraw list.");
+	cDirty = 0;
+
+	if (listen_port > 0) {
+		if ((listen_fd = Feedback_Listen(listen_port, group)) < 0)
+			DIE("Couldn't create and bind receiving socket.");
+	} else if (group) {
+		DIE("Multicast groups can only be joined on a receiving "
+		    "port (-L option).");
+	} else if (!listen_port) {
+		if (socket_fd < 0)
+			DIE("Can't receive OSC messages on the sending socket "
+			    "without dispatching to a socket destination.");
+		listen_fd = socket_fd;
+	}
+
+	if (listen_fd >= 0 &&
+	    !(feedbackThread = Feedback_InitThread(&listen_fd)))
+		DIE("Error initializing the OSC receiving thread.");
+
+	if (Latency_InitSignal())
+		DIE("Couldn't install signal handler.");
+
+	Latency_Input = Latency_Now();
+	if (dispatch && EnqueueAllControls(curTab))
 		DIE("Couldn't enqueue OSC message.");
 
 			/* draw control interface */
 
 	if (Graphics_BlankRect(s, NULL))
 		DIE("Couldn't set background color.");
-	SDL_UpdateRect(s, 0, 0, 0, 0);
+	Graphics_Damage(s, NULL);
 
 	if (DrawAllControls(s, curTab))
 		DIE("Couldn't draw control.");
+	Graphics_Flush(s);
+
+	if (record && Replay_StartRecording(record))
+		DIE("Couldn't create input event recording.");
+
+	if (replay && !(replayThread = Replay_InitThread(replay)))
+		DIE("Error initializing the input event replay thread.");
+
+	/*
+	 * pending events are handled before the queued controls are redrawn,
+	 * at most once per frame. when the frame is due, the controls are
+	 * redrawn even if more events are pending, so a steady stream of
+	 * events cannot postpone redraws indefinitely. OSC messages are sent
+	 * as soon as the events have been handled.
+	 */
+
+	for (;;) {
+		if (Latency_DumpRequested())
+			Latency_Dump(stderr);
+
+		if (Hud_Due()) {
+			if (Hud_Update(s))
+				DIE("Couldn't draw HUD.");
+			Graphics_Flush(s);
+		}
+
+		if (cDirty && (Sint32)(SDL_GetTicks() - frame) >= 0) {
+			if (DrawDirtyControls(s))
+				DIE("Couldn't draw control.");
+			if (display.fps)
+				frame = SDL_GetTicks() + 1000/display.fps;
+		}
+
+		if (!cDirty && !hud.visible) {
+			if (!WaitEvent(&event))
+				DIE("Error retrieving event.");
+		} else if (!PollEventUntil(&event, cDirty ? frame : hud.next)) {
+			continue;
+		}
+
+		Latency_Input = Latency_Now();
+		Hud_CountEvent();
+
+		if (Replay_Record(&event))
+			DIE("Couldn't record input event.");
 
-	while (SDL_WaitEvent(&event))
 		switch (event.type) {
 		case SDL_KEYUP:
 			switch (event.key.keysym.sym) {
@@ -450,6 +693,24 @@ int main(int argc, char **argv)
 				SDL_ShowCursor(ToggleCursor());
 				break;
 
+			case SDLK_l: /* dump latency statistics */
+				Latency_Dump(stderr);
+				break;
+
+			case SDLK_h: /* toggle HUD */
+				if (Hud_Toggle())
+					break;
+
+				/* restore the screen below */
+				if (Graphics_BlankRect(s, NULL))
+					DIE("Couldn't set background color.");
+				Graphics_Damage(s, NULL);
+
+				if (DrawAllControls(s, curTab))
+					DIE("Couldn't draw control.");
+				Graphics_Flush(s);
+				break;
+
 			case SDLK_q: /* quit */
 			case SDLK_ESCAPE:
 				goto finish;
@@ -465,12 +726,10 @@ int main(int argc, char **argv)
 					field->value = field->type == FIELD_BUTTON ?
 									0 : !field->value;
 
-					if (host && Field_EnqueueMessage(cur))
+					if (dispatch && Field_EnqueueMessage(cur))
 						DIE("Couldn't enqueue OSC message.");
 
-					if (Controls_Field(s, cur))
-						DIE("Couldn't draw control.");
-
+					MarkDirty(cur);
 					break;
 				}
 				}
@@ -489,11 +748,10 @@ int main(int argc, char **argv)
 					if (field->type == FIELD_BUTTON) {
 						field->value = 1;
 
-						if (host && Field_EnqueueMessage(cur))
+						if (dispatch && Field_EnqueueMessage(cur))
 							DIE("Couldn't enqueue OSC message.");
 
-						if (Controls_Field(s, cur))
-							DIE("Couldn't draw control.");
+						MarkDirty(cur);
 					}
 					break;
 				}
@@ -503,14 +761,17 @@ int main(int argc, char **argv)
 			if (cur)
 				switch (cur->type) {
 				case SLIDER:
-					if (UpdateSliderValue(s, cur, motion))
+					if (event.type == SDL_MOUSEMOTION &&
+					    FoldMotionEvents(motion))
+						DIE("Couldn't record input event.");
+
+					if (UpdateSliderValue(cur, motion))
 						DIE("Couldn't update control value.");
 
-					if (host && Slider_EnqueueMessage(cur))
+					if (dispatch && Slider_EnqueueMessage(cur))
 						DIE("Couldn't enqueue OSC message.");
 
-					if (Controls_Slider(s, cur))
-						DIE("Couldn't draw control.");
+					MarkDirty(cur);
 					break;
 				}
 			break;
@@ -519,35 +780,79 @@ int main(int argc, char **argv)
 			switch ((enum Controller_Event)event.user.code) {
 			case CONTROLLER_ERR_THREAD:
 				DIE("Error during OSC thread execution.");
+
+			case CONTROLLER_FEEDBACK:
+				if (ApplyFeedback(curTab, cur))
+					DIE("Couldn't apply received values.");
+				break;
 			}
 			break;
 
 		case SDL_QUIT: /* quit */
 			goto finish;
 		}
-	DIE("Error retrieving event.");
+
+		if (replayThread && Replay_Acknowledge(&event))
+			DIE("Error during input event replay.");
+	}
 
 finish:
 
-	FreeRegistry();
-	SDL_FreeSurface(s);
-	if (host) {
-		Osc_Disconnect(socket_fd);
-		if (Osc_TerminateThread())
+	if (replayThread) {
+		Replay_TerminateThread(replayThread);
+		replayThread = NULL;
+	}
+	if (Replay_StopRecording())
+		DIE("Couldn't write input event recording.");
+
+	if (feedbackThread) {
+		Feedback_TerminateThread(feedbackThread, listen_fd);
+		if (listen_fd != socket_fd)
+			close(listen_fd);
+	}
+
+	/* the OSC threads may still reference the templates */
+	if (dispatch) {
+		/* a replay is complete only when all its messages are sent */
+		if (replay && Osc_Drain(REPLAY_DRAIN))
+			fprintf(stderr, "Not all OSC messages of the replay "
+					"could be sent.\n");
+
+		if (Osc_TerminateThreads())
 			return 1;
+
+		if (osc_config.stats)
+			Osc_DumpStats(stderr);
 	}
 
+	free(dirty);
+	FreeRegistry();
+	Graphics_FreeGlyphCache();
+	SDL_FreeSurface(s);
+
+	if (osc_config.stats)
+		Graphics_DumpStats(stderr);
+	/* latencies are always recorded */
+	Latency_Dump(stderr);
+
 	return 0;
 
 err:
 
+	if (replayThread)
+		Replay_TerminateThread(replayThread);
+	Replay_StopRecording();
+	if (feedbackThread)
+		Feedback_TerminateThread(feedbackThread, listen_fd);
+	if (listen_fd >= 0 && listen_fd != socket_fd)
+		close(listen_fd);
+	Osc_TerminateThreads();
+
+	free(dirty);
 	FreeRegistry();
+	Graphics_FreeGlyphCache();
 	if (s)
 		SDL_FreeSurface(s);
-	if (oscThread)
-		Osc_TerminateThread();
-	if (socket_fd > 0)
-		Osc_Disconnect(socket_fd);
 
 	return 1;
 }
@@ -5,6 +5,7 @@
 #include <SDL.h>
 
 #include "controls.h"
+#include "hittest.h"
 
 extern struct Display {
 	int	width;
@@ -15,6 +16,8 @@ extern struct Display {
 	Uint32	flags;
 	int	cursor;
 
+	int	fps;		/* max. redraws per second, 0: unlimited */
+
 	Uint32	foreground;
 	Uint32	background;
 } display;
@@ -24,9 +27,13 @@ extern struct Registry {
 		struct Control	*controls;
 		Uint32		cControls;
 
+		struct HitTest_Grid grid;
+
 		char		*label;
 	} *tabs;
 	Uint32 cTabs;
+
+	char *destinations;	/* OSC destinations of interface or NULL */
 } registry;
 
 #ifndef PACKAGE_NAME
@@ -48,7 +55,8 @@ extern struct Registry {
 
 enum Controller_Event {
 	CONTROLLER_OK = 0,
-	CONTROLLER_ERR_THREAD
+	CONTROLLER_ERR_THREAD,
+	CONTROLLER_FEEDBACK	/* values received from application */
 };
 
 #endif
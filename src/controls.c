@@ -3,6 +3,7 @@
 #include "config.h"
 #endif
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <SDL.h>
@@ -11,141 +12,420 @@
 #include "controls.h"
 #include "controller.h"
 
-int
-Controls_Slider(SDL_Surface *s, struct Control *c)
+static const Uint32 *Controls_MapGradient(SDL_Surface *s,
+					  struct Paint_Grad *grad, Uint16 n);
+
+/*
+ * colors of a gradient with n rows/steps (plus the color following the
+ * last one), mapped once and kept until the number of rows/steps or the
+ * surface format changes
+ */
+
+static const Uint32 *
+Controls_MapGradient(SDL_Surface *s, struct Paint_Grad *grad, Uint16 n)
 {
-	struct Slider	*slider = &c->u.slider;
-	struct Paint	*paint = &slider->paint;
+	float	cr = grad->bottom.r, cg = grad->bottom.g, cb = grad->bottom.b;
+	float	diff_r = (float)(grad->top.r - cr)/n;
+	float	diff_g = (float)(grad->top.g - cg)/n;
+	float	diff_b = (float)(grad->top.b - cb)/n;
+
+	if (grad->colors && grad->cColors == n + 1 &&
+	    grad->format == s->format &&
+	    grad->format_version == s->format_version)
+		return grad->colors;
+
+	free(grad->colors);
+	if (!(grad->colors = malloc((n + 1)*sizeof(Uint32)))) {
+		grad->cColors = 0;
+		return NULL;
+	}
+	grad->cColors = n + 1;
+	grad->format = s->format;
+	grad->format_version = s->format_version;
+
+	for (Uint16 i = 0; i <= n; i++) {
+		grad->colors[i] = SDL_MapRGB(s->format, cr, cg, cb);
 
-	Uint32		border_color;
+		cr += diff_r;
+		cg += diff_g;
+		cb += diff_b;
+	}
 
-	Uint16		padding = SLIDER_PADDING(c);
-	SDL_Rect	bar;
+	return grad->colors;
+}
 
-	if (Graphics_BlankRect(s, &c->geo))
+/*
+ * (re)creates the retained surface of a slider if necessary
+ */
+
+static inline int
+Controls_RetainSlider(SDL_Surface *s, struct Control *c)
+{
+	struct Slider_Retained *retained = &c->u.slider.retained;
+
+	if (retained->surface &&
+	    retained->format == s->format &&
+	    retained->format_version == s->format_version &&
+	    retained->surface->w == c->geo.w &&
+	    retained->surface->h == c->geo.h)
+		return 0;
+
+	SDL_FreeSurface(retained->surface);
+	if (!(retained->surface = Graphics_CreateCompatible(s, c->geo.w,
+							    c->geo.h)))
 		return 1;
 
-	bar.x = c->geo.x + padding;
-	bar.w = c->geo.w - (padding << 1);
+	retained->format = s->format;
+	retained->format_version = s->format_version;
+	retained->valid = 0;
 
-	if (slider->step) { /* stepwise */
-		float	cr, cg, cb;
-		float	diff_r, diff_g, diff_b;
+	return 0;
+}
 
-		Uint32	color;
+/*
+ * extend the row range [*y0, *y1) by [top, bottom)
+ */
 
-		Uint16	steps = (slider->max - slider->min)/slider->step;
-		float	box_s = (float)(c->geo.h - padding)/steps;
-		float	fy = c->geo.y + c->geo.h - box_s;
+static inline void
+Controls_AddRows(Sint32 *y0, Sint32 *y1, Sint32 top, Sint32 bottom)
+{
+	if (top >= bottom)
+		return;
 
-		bar.h = box_s - padding;
+	if (top < *y0)
+		*y0 = top;
+	if (bottom > *y1)
+		*y1 = bottom;
+}
 
-		switch (paint->type) {
-		case PAINT_PLAIN:
-			color = border_color = paint->u.plain.color;
-			break;
+/*
+ * fill the part of rect within the rows [y0, y1)
+ */
 
-		case PAINT_GRAD: {
-			struct Paint_Grad *grad = &paint->u.grad;
+static inline int
+Controls_FillRows(SDL_Surface *s, const SDL_Rect *rect, Sint32 y0, Sint32 y1,
+		  Uint32 color)
+{
+	SDL_Rect clipped = *rect;
 
-			cr = grad->bottom.r;
-			cg = grad->bottom.g;
-			cb = grad->bottom.b;
+	if (y0 < rect->y)
+		y0 = rect->y;
+	if (y1 > rect->y + rect->h)
+		y1 = rect->y + rect->h;
+	if (y0 >= y1)
+		return 0;
 
-			diff_r = (float)(grad->top.r - cr)/steps;
-			diff_g = (float)(grad->top.g - cg)/steps;
-			diff_b = (float)(grad->top.b - cb)/steps;
+	clipped.y = y0;
+	clipped.h = y1 - y0;
 
-			break;
+	return Graphics_FillRect(s, &clipped, color);
+}
+
+/*
+ * same for gradients: Graphics_GradFillRect() fills the rows
+ * (rect->y, rect->y + rect->h] with colors from the bottom up
+ */
+
+static inline void
+Controls_GradFillRows(SDL_Surface *s, const SDL_Rect *rect, Sint32 y0,
+		      Sint32 y1, const Uint32 *colors)
+{
+	SDL_Rect clipped = *rect;
+
+	if (y0 < rect->y + 1)
+		y0 = rect->y + 1;
+	if (y1 > rect->y + rect->h + 1)
+		y1 = rect->y + rect->h + 1;
+	if (y0 >= y1)
+		return;
+
+	clipped.y = y0 - 1;
+	clipped.h = y1 - y0;
+
+	Graphics_GradFillRect(s, &clipped, colors + (rect->y + rect->h + 1 - y1));
+}
+
+/*
+ * sliders are rendered into a retained offscreen surface which is
+ * composited onto the screen with a single blit.
+ * the variable parts (bar, button) lie within the track inside the
+ * border. only the rows between the last drawn and the current bar height
+ * (or step count) and those of the last drawn button are repainted and
+ * composited. the border and label are only redrawn when their color
+ * changes or the slider has been invalidated. without padding, bars cover
+ * the border and everything is redrawn.
+ */
+
+int
+Controls_Slider(SDL_Surface *s, struct Control *c)
+{
+	struct Slider		*slider = &c->u.slider;
+	struct Paint		*paint = &slider->paint;
+	struct Slider_Retained	*retained = &slider->retained;
+
+	SDL_Surface		*r;
+	Uint32			border_color;
+	const Uint32		*colors = NULL;
+	int			full, border;
+
+	Uint16			padding = SLIDER_PADDING(c);
+	SDL_Rect		bar;
+
+	Uint16			steps, cSteps = 0;
+	float			box_s;
+
+	Sint32			y0, y1;	/* rows to repaint */
+
+	SDL_Rect geo = {		/* in retained surface */
+		.x = 0,
+		.y = 0,
+		.w = c->geo.w,
+		.h = c->geo.h
+	};
+	SDL_Rect track = {
+		.x = 1,
+		.y = 1,
+		.w = c->geo.w > 2 ? c->geo.w - 2 : 0,
+		.h = c->geo.h > 2 ? c->geo.h - 2 : 0
+	};
+
+	if (Controls_RetainSlider(s, c))
+		return 1;
+	r = retained->surface;
+
+	if ((full = !retained->valid || !padding)) {
+		y0 = 0;
+		y1 = geo.h;
+	} else {
+		y0 = geo.h;
+		y1 = 0;
+
+		if (slider->type == SLIDER_BUTTON) /* erase last button */
+			Controls_AddRows(&y0, &y1, retained->button.y,
+					 retained->button.y + retained->button.h);
+	}
+
+	bar.x = padding;
+	bar.w = geo.w - (padding << 1);
+
+			/* changed rows */
+
+	if (slider->step) { /* stepwise */
+		steps = (slider->max - slider->min)/slider->step;
+		box_s = (float)(geo.h - padding)/steps;
+
+		bar.h = box_s - padding;
+
+		for (double i = slider->min; i < slider->value; i += slider->step)
+			cSteps++;
+
+		if (!full && cSteps != retained->bar) {
+			Uint16	lo = cSteps < retained->bar ? cSteps : retained->bar;
+			Uint16	hi = cSteps < retained->bar ? retained->bar : cSteps;
+			float	fy = geo.h - box_s;
+
+			for (Uint16 k = 0; k < hi; k++, fy -= box_s)
+				if (k >= lo) {
+					bar.y = fy;
+					Controls_AddRows(&y0, &y1, bar.y,
+							 bar.y + bar.h);
+				}
 		}
+	} else { /* continious */
+		Uint16 max_h = geo.h - (padding << 1);
+
+		bar.h = (slider->value - slider->min)*max_h/
+						(slider->max - slider->min);
+		bar.y = geo.h - padding - bar.h;
+
+		/* one more row since gradients are drawn one row below */
+		if (!full && bar.h != retained->bar)
+			Controls_AddRows(&y0, &y1,
+					 geo.h - padding - (bar.h > retained->bar ?
+							    bar.h : retained->bar),
+					 geo.h - padding + 1 - (bar.h < retained->bar ?
+								bar.h : retained->bar));
+	}
+
+	if (full) {
+		if (Graphics_BlankRect(r, NULL))
+			return 1;
+	} else {
+		if (y0 < track.y)
+			y0 = track.y;
+		if (y1 > track.y + track.h)
+			y1 = track.y + track.h;
+
+		if (y0 < y1) {
+			SDL_Rect rows = {
+				.x = track.x,
+				.y = y0,
+				.w = track.w,
+				.h = y1 - y0
+			};
+
+			if (Graphics_BlankRect(r, &rows))
+				return 1;
 		}
+	}
 
-		for (double i = slider->min; i < slider->value;
-						i += slider->step, fy -= box_s) {
-			if (paint->type == PAINT_GRAD) {
-				color = SDL_MapRGB(s->format, cr, cg, cb);
+			/* repaint */
 
-				cr += diff_r;
-				cg += diff_g;
-				cb += diff_b;
-			}
+	if (slider->step) { /* stepwise */
+		float	fy = geo.h - box_s;
+		Uint16	k = 0;
 
-			bar.y = fy;
+		switch (paint->type) {
+		case PAINT_PLAIN:
+			border_color = paint->u.plain.color;
+			break;
 
-			if (Graphics_FillRect(s, &bar, color))
+		case PAINT_GRAD:
+			if (!(colors = Controls_MapGradient(r, &paint->u.grad,
+							    steps)))
 				return 1;
+			break;
 		}
 
-		if (paint->type == PAINT_GRAD)
-			border_color = SDL_MapRGB(s->format, cr, cg, cb);
-	} else { /* continious */
-		Uint16 max_h = c->geo.h - (padding << 1);
+		for (Uint16 i = 0; i < cSteps; i++, fy -= box_s) {
+			bar.y = fy;
 
-		bar.h = (slider->value - slider->min)*max_h/
-						(slider->max - slider->min);
-		bar.y = c->geo.y + c->geo.h - padding - bar.h;
+			if (colors) {
+				border_color = colors[k];
+				if (k < steps)
+					k++;
+			}
 
+			if (Controls_FillRows(r, &bar, y0, y1, border_color))
+				return 1;
+		}
+
+		if (colors)
+			border_color = colors[k];
+
+		retained->bar = cSteps;
+	} else { /* continious */
 		switch (paint->type) {
 		case PAINT_PLAIN:
 			border_color = paint->u.plain.color;
-			if (Graphics_FillRect(s, &bar, border_color))
+			if (Controls_FillRows(r, &bar, y0, y1, border_color))
 				return 1;
 
 			break;
 
-		case PAINT_GRAD: {
-			SDL_Color border;
-
-			if (Graphics_GradFillRect(s, &bar, max_h,
-						  &paint->u.grad.top,
-						  &paint->u.grad.bottom, &border))
+		case PAINT_GRAD:
+			if (!(colors = Controls_MapGradient(r, &paint->u.grad,
+							    geo.h - (padding << 1))))
 				return 1;
+			Controls_GradFillRows(r, &bar, y0, y1, colors);
 
-			border_color = SDL_MapRGB(s->format, border.r, border.g,
-						  border.b);
+			border_color = colors[bar.h];
 			break;
 		}
-		}
+
+		retained->bar = bar.h;
 	}
 
-	if (Graphics_DrawRect(s, &c->geo, border_color))
-		return 1;
+	if ((border = full || border_color != retained->border_color)) {
+		if (Graphics_DrawRect(r, &geo, border_color))
+			return 1;
+	}
 
 	if (slider->type == SLIDER_BUTTON) {
-		bar.w = c->geo.w - 2;	/* reuse 'bar' */
+		bar.w = track.w;	/* reuse 'bar' */
 		bar.h = padding << 1;
-		bar.x = c->geo.x + 1;
-		bar.y = slider->u.button.button_y;
+		bar.x = track.x;
+		bar.y = slider->u.button.button_y - c->geo.y;
+
+		/* keep the button on the track */
+		if (bar.y < track.y) {
+			bar.h = bar.h > track.y - bar.y ? bar.h - (track.y - bar.y)
+							: 0;
+			bar.y = track.y;
+		}
 
-		if (Graphics_FillRect(s, &bar, border_color))
+		if (Graphics_FillRect(r, &bar, border_color))
 			return 1;
+
+		Controls_AddRows(&y0, &y1, bar.y, bar.y + bar.h);
+		retained->button = bar;
+	}
+
+			/* composite changed rows */
+
+	if (border) {
+		y0 = 0;
+		y1 = geo.h;
 	}
 
-	SDL_UpdateRects(s, 1, &c->geo);
+	if (y0 < y1) {
+		SDL_Rect src = {
+			.x = 0,
+			.y = y0,
+			.w = geo.w,
+			.h = y1 - y0
+		};
+		SDL_Rect dst = {
+			.x = c->geo.x,
+			.y = c->geo.y + y0,
+			.w = geo.w,
+			.h = y1 - y0
+		};
+
+		if (Graphics_Blit(r, &src, s, &dst))
+			return 1;
+
+		dst.w = src.w;
+		dst.h = src.h;
+		Graphics_Damage(s, &dst);
+	}
 
 			/* slider label */
 
-	if (slider->label) {
-		if (Graphics_WriteText(s, c->geo.x, c->geo.y - FONTHEIGHT,
-				       slider->label, border_color))
+	if (slider->label && border) {
+		SDL_Rect text = {
+			.x = c->geo.x,
+			.y = c->geo.y - FONTHEIGHT,
+			.w = strlen(slider->label)*FONTWIDTH,
+			.h = FONTHEIGHT
+		};
+
+		if (Graphics_WriteText(s, text.x, text.y, slider->label,
+				       border_color))
 			return 1;
-		SDL_UpdateRect(s, c->geo.x, c->geo.y - FONTHEIGHT,
-			       strlen(slider->label)*FONTWIDTH, FONTHEIGHT);
+		Graphics_Damage(s, &text);
 	}
 
 			/* slider value */
 
 	if (slider->show_value) {
-		Uint16 y = c->geo.y + c->geo.h + 1;
-		int len = Graphics_printf(s, c->geo.x, y, border_color,
-					  "%g/%g", slider->value, slider->max);
+		SDL_Rect text = {
+			.x = c->geo.x,
+			.y = c->geo.y + c->geo.h + 1,
+			.w = slider->value_len*FONTWIDTH,
+			.h = FONTHEIGHT
+		};
+		int len;
+
+		/* previous value text may be longer */
+		if (Graphics_BlankRect(s, &text))
+			return 1;
 
+		len = Graphics_printf(s, text.x, text.y, border_color,
+				      "%g/%g", slider->value, slider->max);
 		if (len == -1)
 			return 1;
 
-		SDL_UpdateRect(s, c->geo.x, y, len*FONTWIDTH, FONTHEIGHT);
+		if (len > slider->value_len)
+			text.w = len*FONTWIDTH;
+		slider->value_len = len;
+
+		Graphics_Damage(s, &text);
 	}
 
+	retained->border_color = border_color;
+	retained->valid = 1;
+
 	return 0;
 }
 
@@ -171,7 +451,7 @@ Controls_Field(SDL_Surface *s, struct Control *c)
 			       display.background : field->color))
 		return 1;
 
-	SDL_UpdateRects(s, 1, &c->geo);
+	Graphics_Damage(s, &c->geo);
 	return 0;
 }
 
@@ -20,6 +20,12 @@ struct Paint {
 		struct Paint_Grad {
 			SDL_Color top;
 			SDL_Color bottom;
+
+			/* mapped colors from bottom to top (per row or step) */
+			Uint32		*colors;
+			Uint16		cColors;
+			SDL_PixelFormat	*format;	/* mapped for */
+			unsigned int	format_version;
 		} grad;
 	} u;
 };
@@ -31,10 +37,17 @@ struct Control {
 	} type;
 
 	SDL_Rect geo;
+	Uint8 dirty;		/* queued for redraw */
 
 	struct Control_OSC {
 		char			*address;
 		enum Osc_DataType	datatype;
+
+		struct Osc_Template	template;
+
+					/* value received from application */
+		double			feedback;
+		Uint8			feedback_pending;
 	} OSC;
 
 	union {
@@ -59,6 +72,21 @@ struct Control {
 
 			char		*label;
 			Uint8		show_value;
+			Uint16		value_len; /* length of drawn value text */
+
+			/* offscreen rendering of geo (s.a. Controls_Slider) */
+			struct Slider_Retained {
+				SDL_Surface	*surface;
+				SDL_PixelFormat	*format;	/* of screen */
+				unsigned int	format_version;
+
+				/* last drawn */
+				Uint32		border_color;
+				Uint16		bar;	/* height or steps */
+				SDL_Rect	button;
+
+				Uint8		valid;
+			} retained;
 
 			union {
 				struct Slider_Button {
@@ -85,6 +113,8 @@ struct Control {
 
 static inline void Controls_SetSliderValue(struct Slider *slider, double value);
 static inline void Controls_InitSliderButton(struct Control *c);
+static inline void Controls_SetValue(struct Control *c, double value);
+static inline void Controls_Invalidate(struct Control *c);
 
 int Controls_Slider(SDL_Surface *s, struct Control *c);
 int Controls_Field(SDL_Surface *s, struct Control *c);
@@ -109,5 +139,41 @@ Controls_InitSliderButton(struct Control *c)
 					 (slider->max - slider->min)) - padding;
 }
 
-#endif
+static inline void
+Controls_SetValue(struct Control *c, double value)
+{
+	switch (c->type) {
+	case SLIDER: {
+		struct Slider *slider = &c->u.slider;
+
+		if (value >= slider->max)
+			slider->value = slider->max;
+		else if (value <= slider->min)
+			slider->value = slider->min;
+		else
+			Controls_SetSliderValue(slider, value);
+
+		if (slider->type == SLIDER_BUTTON)
+			Controls_InitSliderButton(c);
+		break;
+	}
+
+	case FIELD:
+		c->u.field.value = value != 0;
+		break;
+	}
+}
+
+/*
+ * forces a complete redraw of the control, e.g. after the screen has been
+ * cleared
+ */
+
+static inline void
+Controls_Invalidate(struct Control *c)
+{
+	if (c->type == SLIDER)
+		c->u.slider.retained.valid = 0;
+}
 
+#endif
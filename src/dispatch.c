@@ -0,0 +1,314 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#include "controls.h"
+#include "controller.h"
+#include "dispatch.h"
+
+/*
+ * index of the controls' OSC addresses: a trie over the address segments
+ * with the children of every node sorted by segment, built once after the
+ * interface has been loaded.
+ * literal addresses are resolved by a binary search on each level.
+ * segments containing OSC 1.0 pattern wildcards ('*', '?', '[]' and '{}')
+ * are matched against all children of the node.
+ */
+
+static struct Dispatch_Node {
+	char			*segment;
+	Uint32			length;
+
+	struct Dispatch_Node	*children;
+	Uint32			cChildren;
+
+	struct Control		**controls;	/* controls with this address */
+	Uint32			cControls;
+} Dispatch_Root;
+
+#define DISPATCH_WILDCARDS "*?[{"
+
+static inline int Dispatch_CompareSegment(const struct Dispatch_Node *node,
+					  const char *segment, Uint32 length);
+static inline Uint32 Dispatch_Search(const struct Dispatch_Node *node,
+				     const char *segment, Uint32 length);
+static struct Dispatch_Node *Dispatch_Insert(struct Dispatch_Node *node,
+					     const char *segment,
+					     Uint32 length);
+static void Dispatch_FreeNode(struct Dispatch_Node *node);
+
+static int Dispatch_MatchSegment(const char *p, const char *pend,
+				 const char *s, const char *send);
+static int Dispatch_Visit(struct Dispatch_Node *node, const char *next,
+			  Dispatch_Callback cb, void *ud);
+static int Dispatch_Walk(struct Dispatch_Node *node, const char *address,
+			 Dispatch_Callback cb, void *ud);
+
+static inline int
+Dispatch_CompareSegment(const struct Dispatch_Node *node, const char *segment,
+			Uint32 length)
+{
+	int r = memcmp(node->segment, segment,
+		       node->length < length ? node->length : length);
+
+	return r ? r : (int)node->length - (int)length;
+}
+
+/*
+ * position of the child with the given segment or where to insert it
+ */
+
+static inline Uint32
+Dispatch_Search(const struct Dispatch_Node *node, const char *segment,
+		Uint32 length)
+{
+	Uint32 l = 0, r = node->cChildren;
+
+	while (l < r) {
+		Uint32 m = (l + r)/2;
+
+		if (Dispatch_CompareSegment(node->children + m,
+					    segment, length) < 0)
+			l = m + 1;
+		else
+			r = m;
+	}
+
+	return l;
+}
+
+static struct Dispatch_Node *
+Dispatch_Insert(struct Dispatch_Node *node, const char *segment, Uint32 length)
+{
+	Uint32			i = Dispatch_Search(node, segment, length);
+	struct Dispatch_Node	*child;
+
+	if (i < node->cChildren &&
+	    !Dispatch_CompareSegment(node->children + i, segment, length))
+		return node->children + i;
+
+	child = realloc(node->children,
+			(node->cChildren + 1)*sizeof(struct Dispatch_Node));
+	if (!child)
+		return NULL;
+	node->children = child;
+
+	child += i;
+	memmove(child + 1, child,
+		(node->cChildren - i)*sizeof(struct Dispatch_Node));
+	node->cChildren++;
+
+	memset(child, 0, sizeof(struct Dispatch_Node));
+	/* segments may be empty ("/a//b"), malloc(0) may return NULL */
+	if (!(child->segment = malloc(length + 1))) {
+		node->cChildren--;
+		memmove(child, child + 1,
+			(node->cChildren - i)*sizeof(struct Dispatch_Node));
+		return NULL;
+	}
+	memcpy(child->segment, segment, length);
+	child->length = length;
+
+	return child;
+}
+
+static void
+Dispatch_FreeNode(struct Dispatch_Node *node)
+{
+	for (Uint32 i = 0; i < node->cChildren; i++)
+		Dispatch_FreeNode(node->children + i);
+
+	free(node->children);
+	free(node->controls);
+	free(node->segment);
+}
+
+int
+Dispatch_BuildIndex(void)
+{
+	Dispatch_FreeIndex();
+
+	for (struct Tab *tab = registry.tabs;
+	     tab < registry.tabs + registry.cTabs; tab++)
+		for (struct Control *c = tab->controls;
+		     c < tab->controls + tab->cControls; c++) {
+			struct Dispatch_Node	*node = &Dispatch_Root;
+			struct Control		**controls;
+
+			if (!c->OSC.address)
+				continue;
+
+			for (const char *p = c->OSC.address + 1;; p++) {
+				const char *end = strchr(p, '/');
+				Uint32 length = end ? end - p : strlen(p);
+
+				if (!(node = Dispatch_Insert(node, p, length)))
+					return 1;
+				if (!end)
+					break;
+				p = end;
+			}
+
+			controls = realloc(node->controls,
+					   (node->cControls + 1)*sizeof(struct Control *));
+			if (!controls)
+				return 1;
+
+			node->controls = controls;
+			node->controls[node->cControls++] = c;
+		}
+
+	return 0;
+}
+
+void
+Dispatch_FreeIndex(void)
+{
+	Dispatch_FreeNode(&Dispatch_Root);
+	memset(&Dispatch_Root, 0, sizeof(struct Dispatch_Node));
+}
+
+/*
+ * match a single address segment against an OSC 1.0 pattern segment
+ */
+
+static int
+Dispatch_MatchSegment(const char *p, const char *pend,
+		      const char *s, const char *send)
+{
+	while (p < pend)
+		switch (*p) {
+		case '*':
+			while (p < pend && *p == '*')
+				p++;
+			if (p == pend)
+				return 1;
+
+			for (; s <= send; s++)
+				if (Dispatch_MatchSegment(p, pend, s, send))
+					return 1;
+			return 0;
+
+		case '?':
+			if (s == send)
+				return 0;
+			p++;
+			s++;
+			break;
+
+		case '[': {
+			int negate, match = 0;
+
+			if (s == send)
+				return 0;
+
+			if ((negate = ++p < pend && *p == '!'))
+				p++;
+
+			while (p < pend && *p != ']')
+				if (pend - p > 2 && p[1] == '-' && p[2] != ']') {
+					match |= *s >= p[0] && *s <= p[2];
+					p += 3;
+				} else
+					match |= *s == *p++;
+
+			if (p == pend || match == negate)
+				return 0;
+			p++;
+			s++;
+			break;
+		}
+
+		case '{': {
+			const char *close = memchr(p, '}', pend - p);
+
+			if (!close)
+				return 0;
+
+			for (const char *alt = p + 1; alt <= close;) {
+				const char *comma = alt;
+
+				while (comma < close && *comma != ',')
+					comma++;
+
+				if (send - s >= comma - alt &&
+				    !memcmp(alt, s, comma - alt) &&
+				    Dispatch_MatchSegment(close + 1, pend,
+							  s + (comma - alt), send))
+					return 1;
+
+				alt = comma + 1;
+			}
+			return 0;
+		}
+
+		default:
+			if (s == send || *p != *s)
+				return 0;
+			p++;
+			s++;
+		}
+
+	return s == send;
+}
+
+static int
+Dispatch_Visit(struct Dispatch_Node *node, const char *next,
+	       Dispatch_Callback cb, void *ud)
+{
+	if (next)
+		return Dispatch_Walk(node, next + 1, cb, ud);
+
+	for (Uint32 i = 0; i < node->cControls; i++)
+		if (cb(node->controls[i], ud))
+			return 1;
+
+	return 0;
+}
+
+static int
+Dispatch_Walk(struct Dispatch_Node *node, const char *address,
+	      Dispatch_Callback cb, void *ud)
+{
+	const char	*next = strchr(address, '/');
+	Uint32		length = next ? next - address : strlen(address);
+
+	Uint32		i;
+
+	if (strcspn(address, DISPATCH_WILDCARDS) < length) {
+		for (i = 0; i < node->cChildren; i++) {
+			struct Dispatch_Node *child = node->children + i;
+
+			if (Dispatch_MatchSegment(address, address + length,
+						  child->segment,
+						  child->segment + child->length) &&
+			    Dispatch_Visit(child, next, cb, ud))
+				return 1;
+		}
+
+		return 0;
+	}
+
+	i = Dispatch_Search(node, address, length);
+
+	return i < node->cChildren &&
+	       !Dispatch_CompareSegment(node->children + i, address, length) &&
+	       Dispatch_Visit(node->children + i, next, cb, ud);
+}
+
+/*
+ * call back for every control matching the (possibly wildcarded) address.
+ * returns nonzero if a callback failed.
+ */
+
+int
+Dispatch_Lookup(const char *address, Dispatch_Callback cb, void *ud)
+{
+	return *address == '/' &&
+	       Dispatch_Walk(&Dispatch_Root, address + 1, cb, ud);
+}
@@ -0,0 +1,15 @@
+#ifndef __DISPATCH_H
+#define __DISPATCH_H
+
+#include <SDL.h>
+
+#include "controls.h"
+
+typedef int (*Dispatch_Callback)(struct Control *c, void *ud);
+
+int Dispatch_BuildIndex(void);
+void Dispatch_FreeIndex(void);
+
+int Dispatch_Lookup(const char *address, Dispatch_Callback cb, void *ud);
+
+#endif
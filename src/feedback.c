@@ -0,0 +1,456 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __WATCOMC__
+# include <types.h>
+# include <tcpustd.h>
+#endif
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <errno.h>
+
+#include <SDL.h>
+#include <SDL_thread.h>
+
+#include "controller.h"
+#include "controls.h"
+#include "atomics.h"
+#include "osc.h"
+#include "dispatch.h"
+#include "feedback.h"
+
+/*
+ * values received from the application are stored in the controls'
+ * mailboxes by the receiving thread and applied by the main thread.
+ * updated controls are collected in a (double buffered) list and the main
+ * thread is notified only once per non-empty list, so a burst of updates
+ * results in at most one redraw per control. if the SDL event queue is
+ * full, the notification is retried with the next message or receive
+ * timeout.
+ */
+
+#define FEEDBACK_PACKET_SIZE 4096
+#define FEEDBACK_TIMEOUT	1	/* s, to check for termination */
+
+static struct Feedback_Mailbox {
+	SDL_mutex	*mutex;
+
+	struct Control	**updated[2];
+	Uint32		cUpdated;
+	int		current;	/* list filled by receiving thread */
+	int		notified;	/* main thread knows about the list */
+
+	volatile int	terminate;
+} Feedback_Mailbox;
+
+static int SDLCALL Feedback_ReceiveThread(void *ud);
+
+static inline Uint32 Feedback_StrLen32(const char *str, const char *end);
+static inline int Feedback_DecodeArgument(char type, const char *arg,
+					  const char *end, double *value);
+static int Feedback_DecodeMessage(const char *data, Uint32 size);
+static int Feedback_DecodePacket(const char *data, Uint32 size);
+static int Feedback_Store(struct Control *c, void *ud);
+static int Feedback_Post(const char *address, double value);
+static int Feedback_Notify(void);
+
+/*
+ * optionally subscribes to a multicast group, e.g. to receive the messages
+ * another controller sends to it
+ */
+
+int
+Feedback_Listen(int port, const char *group)
+{
+	struct sockaddr_in	addr;
+	int			fd;
+
+	int			reuse = 1;
+
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+		return -1;
+
+	/* several subscribers on this host share the port */
+	if (group && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR,
+				&reuse, sizeof(reuse)))
+		goto err;
+
+	memset(&addr, 0, sizeof(struct sockaddr_in));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_in)) < 0)
+		goto err;
+
+#ifdef IP_ADD_MEMBERSHIP
+	if (group) {
+		struct ip_mreq mreq;
+
+		if ((mreq.imr_multiaddr.s_addr = inet_addr(group)) ==
+								INADDR_NONE ||
+		    Osc_MulticastInterface(&mreq.imr_interface) ||
+		    setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+			       &mreq, sizeof(mreq)))
+			goto err;
+	}
+#else
+	if (group)
+		goto err;
+#endif
+
+	return fd;
+
+err:
+
+	close(fd);
+	return -1;
+}
+
+/*
+ * must be called after the interface has been loaded
+ */
+
+SDL_Thread *
+Feedback_InitThread(int *fd)
+{
+	SDL_Thread	*thread;
+	Uint32		controls = 0;
+
+	struct timeval timeout = {
+		.tv_sec = FEEDBACK_TIMEOUT,
+		.tv_usec = 0
+	};
+
+	if (setsockopt(*fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+		       sizeof(struct timeval)))
+		return NULL;
+
+	for (struct Tab *tab = registry.tabs;
+	     tab < registry.tabs + registry.cTabs; tab++)
+		controls += tab->cControls;
+
+	Feedback_Mailbox.cUpdated = 0;
+	Feedback_Mailbox.current = 0;
+	Feedback_Mailbox.notified = 0;
+	Feedback_Mailbox.terminate = 0;
+
+	if (!(Feedback_Mailbox.updated[0] = malloc(controls*sizeof(struct Control *))) ||
+	    !(Feedback_Mailbox.updated[1] = malloc(controls*sizeof(struct Control *))) ||
+	    !(Feedback_Mailbox.mutex = SDL_CreateMutex()))
+		goto err;
+
+	if (!(thread = SDL_CreateThread(Feedback_ReceiveThread, fd))) {
+		SDL_DestroyMutex(Feedback_Mailbox.mutex);
+		goto err;
+	}
+
+	return thread;
+
+err:
+
+	free(Feedback_Mailbox.updated[0]);
+	free(Feedback_Mailbox.updated[1]);
+	return NULL;
+}
+
+/*
+ * terminate thread without killing it by setting the termination flag and
+ * waking it up from recv() (shutdown() may fail on unconnected sockets, in
+ * which case the receive timeout applies).
+ * the thread accesses the registry, so we have to wait for it.
+ */
+
+void
+Feedback_TerminateThread(SDL_Thread *thread, int fd)
+{
+	ATOMIC_STORE(&Feedback_Mailbox.terminate, 1);
+	shutdown(fd, SHUT_RD);
+
+	SDL_WaitThread(thread, NULL);
+
+	SDL_DestroyMutex(Feedback_Mailbox.mutex);
+	free(Feedback_Mailbox.updated[0]);
+	free(Feedback_Mailbox.updated[1]);
+}
+
+#define THREAD_ABORT() {			\
+	if (SDL_PushEvent((SDL_Event*)&abort))	\
+		return 1;			\
+	continue;				\
+}
+
+static int SDLCALL
+Feedback_ReceiveThread(void *ud)
+{
+	int fd = *(int*)ud;
+
+	static const SDL_Event abort = {
+		.type = SDL_USEREVENT,
+		.user = {
+			.type = SDL_USEREVENT,
+			.code = CONTROLLER_ERR_THREAD
+		}
+	};
+
+	for (;;) {
+		Uint32	buffer[FEEDBACK_PACKET_SIZE/sizeof(Uint32)];
+		ssize_t	r;
+
+		do
+			r = recv(fd, buffer, sizeof(buffer), 0);
+		while (r < 0 && (errno == EINTR || errno == ECONNREFUSED));
+			/* ^ ICMP errors of the connected sending socket */
+
+		if (ATOMIC_LOAD(&Feedback_Mailbox.terminate))
+			return 0;
+
+		if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			/* receive timeout */
+			if (Feedback_Notify())
+				THREAD_ABORT();
+			continue;
+		}
+
+		if (r < 0 || Feedback_DecodePacket((char *)buffer, r))
+			THREAD_ABORT();
+	}
+}
+
+/*
+ * length of an OSC string including padding, 0 if it is not terminated
+ * or the padding exceeds the buffer
+ */
+
+static inline Uint32
+Feedback_StrLen32(const char *str, const char *end)
+{
+	const char	*p = memchr(str, '\0', end - str);
+	Uint32		len;
+
+	if (!p)
+		return 0;
+	len = (p - str + sizeof(Uint32)) & ~(sizeof(Uint32) - 1);
+
+	return len <= end - str ? len : 0;
+}
+
+static inline int
+Feedback_DecodeArgument(char type, const char *arg, const char *end,
+			double *value)
+{
+	union {
+		Uint32	i[2];
+		Sint32	s;
+		float	f;
+		double	d;
+		Sint64	h;
+	} v;
+
+	switch (type) {
+	case 'i':
+	case 'f':
+		if (arg + sizeof(Uint32) > end)
+			return 1;
+
+		memcpy(v.i, arg, sizeof(Uint32));
+		v.i[0] = ntohl(v.i[0]);
+
+		*value = type == 'i' ? v.s : v.f;
+		return 0;
+
+	case 'd':
+	case 'h': {
+		Uint64 u;
+
+		if (arg + sizeof(Uint64) > end)
+			return 1;
+
+		memcpy(v.i, arg, sizeof(Uint64));
+		u = (Uint64)ntohl(v.i[0]) << 32 | ntohl(v.i[1]);
+		memcpy(&v, &u, sizeof(Uint64));
+
+		*value = type == 'd' ? v.d : v.h;
+		return 0;
+	}
+
+	case 'T':
+		*value = 1;
+		return 0;
+
+	case 'F':
+		*value = 0;
+		return 0;
+
+	case 's': {
+		char *p;
+
+		if (!Feedback_StrLen32(arg, end))
+			return 1;
+
+		*value = strtod(arg, &p);
+		return p == arg;
+	}
+	}
+
+	return 1;
+}
+
+/*
+ * only the first argument of a message is evaluated,
+ * malformed messages are ignored
+ */
+
+static int
+Feedback_DecodeMessage(const char *data, Uint32 size)
+{
+	const char	*end = data + size;
+	const char	*types;
+	Uint32		len;
+
+	double		value;
+
+	if (*data != '/' || !(len = Feedback_StrLen32(data, end)))
+		return 0;
+	types = data + len;
+
+	if (types >= end || *types != ',' ||
+	    !(len = Feedback_StrLen32(types, end)) ||
+	    Feedback_DecodeArgument(types[1], types + len, end, &value))
+		return 0;
+
+	return Feedback_Post(data, value);
+}
+
+static int
+Feedback_DecodePacket(const char *data, Uint32 size)
+{
+	const char *end = data + size;
+
+	if (size < 16 || memcmp(data, "#bundle", 8))
+		return size >= sizeof(Uint32) ? Feedback_DecodeMessage(data, size)
+					      : 0;
+
+	/* bundle elements; the time tag is ignored */
+	for (data += 16; data + sizeof(Uint32) < end;) {
+		Uint32 element;
+
+		memcpy(&element, data, sizeof(Uint32));
+		element = ntohl(element);
+		data += sizeof(Uint32);
+
+		if (element > end - data)
+			break;
+		if (Feedback_DecodePacket(data, element))
+			return 1;
+
+		data += element;
+	}
+
+	return 0;
+}
+
+/*
+ * called with the mailbox locked for every control matching the address
+ */
+
+static int
+Feedback_Store(struct Control *c, void *ud)
+{
+	struct Control_OSC *osc = &c->OSC;
+
+	osc->feedback = *(double *)ud;
+
+	if (!osc->feedback_pending) {
+		osc->feedback_pending = 1;
+		Feedback_Mailbox.updated[Feedback_Mailbox.current]
+			[Feedback_Mailbox.cUpdated++] = c;
+	}
+
+	return 0;
+}
+
+static int
+Feedback_Post(const char *address, double value)
+{
+	if (SDL_LockMutex(Feedback_Mailbox.mutex))
+		return 1;
+
+	Dispatch_Lookup(address, Feedback_Store, &value);
+
+	if (SDL_UnlockMutex(Feedback_Mailbox.mutex))
+		return 1;
+
+	return Feedback_Notify();
+}
+
+/*
+ * notify the main thread of pending updates unless it has been already;
+ * a full event queue is not an error, the next call retries
+ */
+
+static int
+Feedback_Notify(void)
+{
+	static const SDL_Event notify = {
+		.type = SDL_USEREVENT,
+		.user = {
+			.type = SDL_USEREVENT,
+			.code = CONTROLLER_FEEDBACK
+		}
+	};
+
+	if (SDL_LockMutex(Feedback_Mailbox.mutex))
+		return 1;
+
+	if (Feedback_Mailbox.cUpdated && !Feedback_Mailbox.notified)
+		Feedback_Mailbox.notified = !SDL_PushEvent((SDL_Event*)&notify);
+
+	return SDL_UnlockMutex(Feedback_Mailbox.mutex) != 0;
+}
+
+/*
+ * called by the main thread: applies all received values except for the
+ * ignored (i.e. currently manipulated) control and returns the list of
+ * updated controls to redraw
+ */
+
+struct Control **
+Feedback_Apply(struct Control *ignore, Uint32 *count)
+{
+	struct Control	**updated;
+	Uint32		c = 0;
+
+	if (SDL_LockMutex(Feedback_Mailbox.mutex))
+		return NULL;
+
+	updated = Feedback_Mailbox.updated[Feedback_Mailbox.current];
+
+	for (Uint32 i = 0; i < Feedback_Mailbox.cUpdated; i++) {
+		struct Control *control = updated[i];
+
+		control->OSC.feedback_pending = 0;
+
+		if (control != ignore) {
+			Controls_SetValue(control, control->OSC.feedback);
+			updated[c++] = control;
+		}
+	}
+
+	Feedback_Mailbox.current ^= 1;
+	Feedback_Mailbox.cUpdated = 0;
+	Feedback_Mailbox.notified = 0;
+
+	if (SDL_UnlockMutex(Feedback_Mailbox.mutex))
+		return NULL;
+
+	*count = c;
+	return updated;
+}
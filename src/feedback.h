@@ -0,0 +1,16 @@
+#ifndef __FEEDBACK_H
+#define __FEEDBACK_H
+
+#include <SDL.h>
+#include <SDL_thread.h>
+
+#include "controls.h"
+
+int Feedback_Listen(int port, const char *group);
+
+SDL_Thread *Feedback_InitThread(int *fd);
+void Feedback_TerminateThread(SDL_Thread *thread, int fd);
+
+struct Control **Feedback_Apply(struct Control *ignore, Uint32 *count);
+
+#endif
@@ -3,12 +3,18 @@
 #include "config.h"
 #endif
 
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdarg.h>
 
 #include <SDL.h>
 
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define GRAPHICS_X86
+#include <immintrin.h>
+#endif
+
 #include "controller.h"
 #include "graphics.h"
 
@@ -23,109 +29,456 @@
 	return 0;					\
 }
 
+/* same for primitives started with GRAPHICS_PROFILE_START() */
+#define PROFILED_UNLOCK(S, P) {				\
+	if (SDL_MUSTLOCK(S))				\
+		SDL_UnlockSurface(S);			\
+	return GRAPHICS_PROFILED(P, 0);			\
+}
+
 #define XYTOPTR(S, X, Y, BPP)	((Uint8*)(S)->pixels + (Y)*(S)->pitch + (X)*(BPP))
 #define SETPIXEL(P, BPP, C)	memcpy(P, &(C), BPP)
-#define SAFE_SETPIXEL(P, MAX, BPP, C) {	\
-	if (P < MAX)			\
-		SETPIXEL(P, BPP, C);	\
+
+/*
+ * pixel kernels specialized for each depth: the generic inline versions are
+ * instantiated with a constant bpp, so SETPIXEL() becomes a single store
+ * and 16/32 bit spans are filled with 64 bit stores.
+ * primitives look up the kernels by the surface's bytes per pixel.
+ */
+
+static inline void
+Graphics_FillSpan(Uint8 *p, Uint16 l, Uint32 color, Uint8 bpp)
+{
+	Uint8	pattern[sizeof(Uint64)];
+	Uint64	wide;
+
+	switch (bpp) {
+	case 1:
+		memset(p, color, l);
+		return;
+
+	case 2:
+	case 4:
+		for (; l && (uintptr_t)p % sizeof(Uint64); l--, p += bpp)
+			SETPIXEL(p, bpp, color);
+
+		for (int i = 0; i < sizeof(pattern); i += bpp)
+			SETPIXEL(pattern + i, bpp, color);
+		memcpy(&wide, pattern, sizeof(Uint64));
+
+		for (; l >= sizeof(Uint64)/bpp;
+		     l -= sizeof(Uint64)/bpp, p += sizeof(Uint64))
+			memcpy(p, &wide, sizeof(Uint64));
+		break;
+	}
+
+	for (; l; l--, p += bpp)
+		SETPIXEL(p, bpp, color);
+}
+
+static inline void
+Graphics_FillColumn(Uint8 *p, Uint16 pitch, Uint16 l, Uint32 color, Uint8 bpp)
+{
+	for (; l; l--, p += pitch)
+		SETPIXEL(p, bpp, color);
+}
+
+/*
+ * one line of a glyph: bit 0 is the rightmost pixel at p
+ */
+
+static inline void
+Graphics_FillGlyphLine(Uint8 *p, Uint8 bits, Uint32 color, Uint8 bpp)
+{
+	for (; bits; bits >>= 1, p -= bpp)
+		if (bits & 1)
+			SETPIXEL(p, bpp, color);
+}
+
+#define GRAPHICS_KERNEL(BPP)						\
+static void								\
+Graphics_Span##BPP(Uint8 *p, Uint16 l, Uint32 color)			\
+{									\
+	Graphics_FillSpan(p, l, color, BPP);				\
+}									\
+									\
+static void								\
+Graphics_Column##BPP(Uint8 *p, Uint16 pitch, Uint16 l, Uint32 color)	\
+{									\
+	Graphics_FillColumn(p, pitch, l, color, BPP);			\
+}									\
+									\
+static void								\
+Graphics_Glyph##BPP(Uint8 *p, Uint8 bits, Uint32 color)			\
+{									\
+	Graphics_FillGlyphLine(p, bits, color, BPP);			\
+}
+
+GRAPHICS_KERNEL(1)
+GRAPHICS_KERNEL(2)
+GRAPHICS_KERNEL(3)
+GRAPHICS_KERNEL(4)
+
+#ifdef GRAPHICS_X86
+
+/*
+ * SIMD kernels for 16 and 32 bit surfaces: glyph lines are expanded into
+ * an 8 pixel mask (leftmost pixel = bit 7) and blended into or stored with
+ * a mask into the 8 pixels left of and including p.
+ * spans are filled with 16 byte stores.
+ */
+
+#define GRAPHICS_SSE2 __attribute__((target("sse2")))
+#define GRAPHICS_AVX2 __attribute__((target("avx2")))
+
+static inline GRAPHICS_SSE2 void
+Graphics_FillSpanSSE2(Uint8 *p, Uint16 l, __m128i pattern, Uint32 color,
+		      Uint8 bpp)
+{
+	for (; l && (uintptr_t)p % sizeof(__m128i); l--, p += bpp)
+		SETPIXEL(p, bpp, color);
+
+	for (; l >= sizeof(__m128i)/bpp;
+	     l -= sizeof(__m128i)/bpp, p += sizeof(__m128i))
+		_mm_store_si128((__m128i *)p, pattern);
+
+	for (; l; l--, p += bpp)
+		SETPIXEL(p, bpp, color);
+}
+
+static inline GRAPHICS_SSE2 void
+Graphics_BlendSSE2(Uint8 *p, __m128i mask, __m128i pattern)
+{
+	__m128i dst = _mm_loadu_si128((__m128i *)p);
+
+	dst = _mm_or_si128(_mm_andnot_si128(mask, dst),
+			   _mm_and_si128(mask, pattern));
+	_mm_storeu_si128((__m128i *)p, dst);
+}
+
+static GRAPHICS_SSE2 void
+Graphics_Span2SSE2(Uint8 *p, Uint16 l, Uint32 color)
+{
+	Graphics_FillSpanSSE2(p, l, _mm_set1_epi16(color), color, 2);
+}
+
+static GRAPHICS_SSE2 void
+Graphics_Span4SSE2(Uint8 *p, Uint16 l, Uint32 color)
+{
+	Graphics_FillSpanSSE2(p, l, _mm_set1_epi32(color), color, 4);
+}
+
+static GRAPHICS_SSE2 void
+Graphics_Glyph2SSE2(Uint8 *p, Uint8 bits, Uint32 color)
+{
+	const __m128i lanes = _mm_set_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+
+	if (bits)
+		Graphics_BlendSSE2(p - 7*2,
+				   _mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16(bits),
+								 lanes), lanes),
+				   _mm_set1_epi16(color));
+}
+
+static GRAPHICS_SSE2 void
+Graphics_Glyph4SSE2(Uint8 *p, Uint8 bits, Uint32 color)
+{
+	const __m128i	left = _mm_set_epi32(16, 32, 64, 128);
+	const __m128i	right = _mm_set_epi32(1, 2, 4, 8);
+
+	__m128i		b = _mm_set1_epi32(bits);
+	__m128i		pattern = _mm_set1_epi32(color);
+
+	if (bits & 0xF0)
+		Graphics_BlendSSE2(p - 7*4,
+				   _mm_cmpeq_epi32(_mm_and_si128(b, left), left),
+				   pattern);
+	if (bits & 0x0F)
+		Graphics_BlendSSE2(p - 3*4,
+				   _mm_cmpeq_epi32(_mm_and_si128(b, right), right),
+				   pattern);
+}
+
+static GRAPHICS_AVX2 void
+Graphics_Glyph4AVX2(Uint8 *p, Uint8 bits, Uint32 color)
+{
+	const __m256i	lanes = _mm256_set_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	__m256i		mask;
+
+	if (!bits)
+		return;
+
+	mask = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits),
+						   lanes), lanes);
+	_mm256_maskstore_epi32((int *)(p - 7*4), mask,
+			       _mm256_set1_epi32(color));
+}
+
+#endif /* GRAPHICS_X86 */
+
+static struct Graphics_Kernel {
+	void (*span)(Uint8 *p, Uint16 l, Uint32 color);
+	void (*column)(Uint8 *p, Uint16 pitch, Uint16 l, Uint32 color);
+	void (*glyph)(Uint8 *p, Uint8 bits, Uint32 color);
+} Graphics_Kernels[4];
+
+#define KERNEL(S) (Graphics_Kernels + (S)->format->BytesPerPixel - 1)
+
+/*
+ * selects the kernels, using SIMD instructions up to the given level if
+ * supported by the CPU. returns the level selected.
+ * must be called before drawing.
+ */
+
+enum Graphics_SIMD
+Graphics_Init(enum Graphics_SIMD max)
+{
+	static const struct Graphics_Kernel scalar[] = {
+		{Graphics_Span1, Graphics_Column1, Graphics_Glyph1},
+		{Graphics_Span2, Graphics_Column2, Graphics_Glyph2},
+		{Graphics_Span3, Graphics_Column3, Graphics_Glyph3},
+		{Graphics_Span4, Graphics_Column4, Graphics_Glyph4}
+	};
+	enum Graphics_SIMD level = GRAPHICS_SIMD_NONE;
+
+	memcpy(Graphics_Kernels, scalar, sizeof(scalar));
+
+#ifdef GRAPHICS_X86
+	__builtin_cpu_init();
+
+	if (max >= GRAPHICS_SIMD_SSE2 && __builtin_cpu_supports("sse2")) {
+		Graphics_Kernels[1].span = Graphics_Span2SSE2;
+		Graphics_Kernels[1].glyph = Graphics_Glyph2SSE2;
+		Graphics_Kernels[3].span = Graphics_Span4SSE2;
+		Graphics_Kernels[3].glyph = Graphics_Glyph4SSE2;
+		level = GRAPHICS_SIMD_SSE2;
+	}
+
+	if (max >= GRAPHICS_SIMD_AVX2 && __builtin_cpu_supports("avx2")) {
+		Graphics_Kernels[3].glyph = Graphics_Glyph4AVX2;
+		level = GRAPHICS_SIMD_AVX2;
+	}
+#endif
+
+	return level;
 }
 
 int
 Graphics_DrawHLine(SDL_Surface *s, Uint16 x, Uint16 y, Uint16 l, Uint32 color)
 {
-	Uint8	bpp = s->format->BytesPerPixel;
-	Uint8	*p = XYTOPTR(s, x, y, bpp);
+	Uint8 *p = XYTOPTR(s, x, y, s->format->BytesPerPixel);
 
+	GRAPHICS_PROFILE_START();
 	GENERIC_LOCK(s);
 
-	while (l--) {
-		SETPIXEL(p, bpp, color);
-		p += bpp;
-	}
+	KERNEL(s)->span(p, l, color);
 
-	GENERIC_UNLOCK(s);
+	PROFILED_UNLOCK(s, GRAPHICS_LINE);
 }
 
 int
 Graphics_DrawVLine(SDL_Surface *s, Uint16 x, Uint16 y, Uint16 l, Uint32 color)
 {
-	Uint8	bpp = s->format->BytesPerPixel;
-	Uint8	*p = XYTOPTR(s, x, y, bpp);
+	Uint8 *p = XYTOPTR(s, x, y, s->format->BytesPerPixel);
 
+	GRAPHICS_PROFILE_START();
 	GENERIC_LOCK(s);
 
-	while (l--) {
-		SETPIXEL(p, bpp, color);
-		p += s->pitch;
-	}
+	KERNEL(s)->column(p, s->pitch, l, color);
 
-	GENERIC_UNLOCK(s);
+	PROFILED_UNLOCK(s, GRAPHICS_LINE);
 }
 
 int
 Graphics_DrawRect(SDL_Surface *s, SDL_Rect *rect, Uint32 color)
 {
+	const struct Graphics_Kernel *kernel = KERNEL(s);
+
 	Uint8	bpp = s->format->BytesPerPixel;
-	Uint8	*p = XYTOPTR(s, rect->x + 1, rect->y, bpp);
+	Uint8	*p = XYTOPTR(s, rect->x, rect->y, bpp);
+
+	GRAPHICS_PROFILE_START();
 
-	Uint32	d;
+	if (!rect->w || !rect->h)
+		return 0;
 
 	GENERIC_LOCK(s);
 
 	if (rect->w > 2) {
-		d = (rect->h - 1)*s->pitch;
-
-		for (Uint16 w = rect->w - 2; w; w--, p += bpp) {
-			SETPIXEL(p, bpp, color);
-			SETPIXEL(p + d, bpp, color);
-		}
+		kernel->span(p + bpp, rect->w - 2, color);
+		kernel->span(p + (rect->h - 1)*s->pitch + bpp, rect->w - 2,
+			     color);
 	}
 
-	d = (rect->w - 1)*bpp;
-	for (Uint16 h = rect->h; h; h--, p += s->pitch) {
-		SETPIXEL(p, bpp, color);
-		SETPIXEL(p - d, bpp, color);
-	}
+	kernel->column(p, s->pitch, rect->h, color);
+	kernel->column(p + (rect->w - 1)*bpp, s->pitch, rect->h, color);
 
-	GENERIC_UNLOCK(s);
+	PROFILED_UNLOCK(s, GRAPHICS_LINE);
 }
 
+/*
+ * fills rect from the bottom row to the top with the given (mapped) colors
+ */
+
 int
-Graphics_GradFillRect(SDL_Surface *s, SDL_Rect *rect, Uint16 max,
-		      SDL_Color *top, SDL_Color *bottom, SDL_Color *last)
+Graphics_GradFillRect(SDL_Surface *s, SDL_Rect *rect, const Uint32 *colors)
 {
-	Uint8		bpp = s->format->BytesPerPixel;
-	Uint8		*p = XYTOPTR(s, rect->x, rect->y + rect->h, bpp);
+	const struct Graphics_Kernel *kernel = KERNEL(s);
+
+	Uint8 *p = XYTOPTR(s, rect->x, rect->y + rect->h,
+			   s->format->BytesPerPixel);
+
+	GRAPHICS_PROFILE_START();
+	GENERIC_LOCK(s);
+
+	for (Uint16 h = rect->h; h; h--, colors++, p -= s->pitch)
+		kernel->span(p, rect->w, *colors);
+
+	PROFILED_UNLOCK(s, GRAPHICS_GRAD);
+}
+
+/*
+ * renders text directly from the font bitmaps
+ */
 
-	float		cr = bottom->r, cg = bottom->g, cb = bottom->b;
-	float		diff_r = (float)(top->r - cr)/max;
-	float		diff_g = (float)(top->g - cg)/max;
-	float		diff_b = (float)(top->b - cb)/max;
+static int
+Graphics_RenderText(SDL_Surface *s, Uint16 x, Uint16 y, const char *text,
+		    Uint32 color)
+{
+	const struct Graphics_Kernel *kernel = KERNEL(s);
 
-	Sint8		p_diff = bpp;
+	Uint8	bpp = s->format->BytesPerPixel;
+	Uint8	*p = XYTOPTR(s, x + FONTWIDTH, y, bpp);
+	Uint8	*max = XYTOPTR(s, 0, s->h, 0);
 
 	GENERIC_LOCK(s);
 
-	for (Uint16 h = rect->h; h; h--) {
-		Uint32 color = SDL_MapRGB(s->format, cr, cg, cb);
+	for (const unsigned char *c = (const unsigned char *)text; *c;
+	     c++, p += bpp*FONTWIDTH) {
+		const Uint8	*line = Font_Face[*c];
+		Uint8		*py = p;
 
-		for (Uint16 w = rect->w; w; w--, p += p_diff)
-			SETPIXEL(p, bpp, color);
+		for (Uint8 yc = FONTHEIGHT; yc && py < max;
+		     yc--, line++, py += s->pitch)
+			kernel->glyph(py, *line, color);
+	}
+
+	GENERIC_UNLOCK(s);
+}
+
+/*
+ * glyph cache: for each recently used color and surface format, all glyphs
+ * are rasterized (on first use) into an atlas surface, one glyph per
+ * FONTWIDTH columns, with a color key as background.
+ * text is rendered by blitting glyphs from the atlas.
+ * the least recently used atlas is replaced when the cache is full.
+ */
+
+#define GRAPHICS_ATLAS_MAX	8
+
+struct Graphics_Config graphics_config = {
+	.glyph_cache = 1
+};
+
+static struct Graphics_Atlas {
+	SDL_Surface	*surface;	/* NULL: unused */
+
+	SDL_PixelFormat	*format;	/* of target surface */
+	unsigned int	format_version;
+	Uint32		color;
+
+	Uint32		used;		/* LRU clock */
+	Uint8		rasterized[256/8];
+} Graphics_Atlases[GRAPHICS_ATLAS_MAX];
+
+static Uint32 Graphics_AtlasClock = 0;
 
-		cr += diff_r;
-		cg += diff_g;
-		cb += diff_b;
+static struct Graphics_Atlas *Graphics_GetAtlas(SDL_Surface *s, Uint32 color);
+static inline int Graphics_RasterizeGlyph(struct Graphics_Atlas *atlas,
+					  unsigned char c);
 
-		p -= s->pitch + p_diff;
-		p_diff = -p_diff;
+static struct Graphics_Atlas *
+Graphics_GetAtlas(SDL_Surface *s, Uint32 color)
+{
+	SDL_PixelFormat		*format = s->format;
+	struct Graphics_Atlas	*atlas = Graphics_Atlases;
+
+	for (int i = 0; i < GRAPHICS_ATLAS_MAX; i++) {
+		struct Graphics_Atlas *cur = Graphics_Atlases + i;
+
+		if (cur->surface && cur->format == format &&
+		    cur->format_version == s->format_version &&
+		    cur->color == color) {
+			cur->used = ++Graphics_AtlasClock;
+			return cur;
+		}
+
+		if (cur->used < atlas->used)
+			atlas = cur;
 	}
 
-	if (last) {
-		last->r = cr;
-		last->g = cg;
-		last->b = cb;
+	/* replace least recently used (or unused) atlas */
+	if (atlas->surface) {
+		Graphics_Stats.atlas_evictions++;
+
+		if (atlas->surface->format->BitsPerPixel != format->BitsPerPixel ||
+		    atlas->surface->format->Rmask != format->Rmask ||
+		    atlas->surface->format->Gmask != format->Gmask ||
+		    atlas->surface->format->Bmask != format->Bmask) {
+			SDL_FreeSurface(atlas->surface);
+			atlas->surface = NULL;
+		}
 	}
 
+	if (!atlas->surface) {
+		if (!(atlas->surface = Graphics_CreateCompatible(s, 256*FONTWIDTH,
+								 FONTHEIGHT)))
+			goto err;
+	} else if (format->palette &&
+		   !SDL_SetColors(atlas->surface, format->palette->colors, 0,
+				  format->palette->ncolors))
+		goto err;
+
+	/* any pixel value other than the text color will do as key */
+	if (SDL_SetColorKey(atlas->surface, SDL_SRCCOLORKEY, color ^ 1) ||
+	    SDL_FillRect(atlas->surface, NULL, color ^ 1))
+		goto err;
+
+	atlas->format = format;
+	atlas->format_version = s->format_version;
+	atlas->color = color;
+	atlas->used = ++Graphics_AtlasClock;
+	memset(atlas->rasterized, 0, sizeof(atlas->rasterized));
+
+	return atlas;
+
+err:
+
+	SDL_FreeSurface(atlas->surface);
+	memset(atlas, 0, sizeof(struct Graphics_Atlas));
+	return NULL;
+}
+
+static inline int
+Graphics_RasterizeGlyph(struct Graphics_Atlas *atlas, unsigned char c)
+{
+	SDL_Surface	*s = atlas->surface;
+	Uint8		*p;
+
+	if (atlas->rasterized[c/8] & 1 << c % 8) {
+		Graphics_Stats.glyph_hits++;
+		return 0;
+	}
+	Graphics_Stats.glyph_misses++;
+
+	p = XYTOPTR(s, c*FONTWIDTH + FONTWIDTH - 1, 0, s->format->BytesPerPixel);
+
+	GENERIC_LOCK(s);
+
+	for (Uint8 y = 0; y < FONTHEIGHT; y++, p += s->pitch)
+		KERNEL(s)->glyph(p, Font_Face[c][y], atlas->color);
+	atlas->rasterized[c/8] |= 1 << c % 8;
+
 	GENERIC_UNLOCK(s);
 }
 
@@ -133,27 +486,70 @@ int
 Graphics_WriteText(SDL_Surface *s, Uint16 x, Uint16 y, const char *text,
 		   Uint32 color)
 {
-	Uint8	bpp = s->format->BytesPerPixel;
-	Uint8	*p = XYTOPTR(s, x + FONTWIDTH, y, bpp);
-	Uint8	*max = XYTOPTR(s, 0, s->h, 0);
+	struct Graphics_Atlas *atlas;
+
+	GRAPHICS_PROFILE_START();
+
+	if (!graphics_config.glyph_cache ||
+	    !(atlas = Graphics_GetAtlas(s, color)))
+		return GRAPHICS_PROFILED(GRAPHICS_TEXT,
+					 Graphics_RenderText(s, x, y, text,
+							     color));
+
+	for (const unsigned char *c = (const unsigned char *)text; *c;
+	     c++, x += FONTWIDTH) {
+		SDL_Rect src = {
+			.x = *c*FONTWIDTH,
+			.y = 0,
+			.w = FONTWIDTH,
+			.h = FONTHEIGHT
+		};
+		SDL_Rect dst = {
+			.x = x + 1,
+			.y = y
+		};
+
+		if (Graphics_RasterizeGlyph(atlas, *c) ||
+		    SDL_BlitSurface(atlas->surface, &src, s, &dst))
+			return GRAPHICS_PROFILED(GRAPHICS_TEXT, 1);
+	}
 
-	GENERIC_LOCK(s);
+	return GRAPHICS_PROFILED(GRAPHICS_TEXT, 0);
+}
 
-	for (const char *c = text; *c; c++, p += bpp*FONTWIDTH) {
-		const Uint8	*line = Font_Face[*c];
-		Uint8		*py = p;
+void
+Graphics_FreeGlyphCache(void)
+{
+	for (int i = 0; i < GRAPHICS_ATLAS_MAX; i++)
+		SDL_FreeSurface(Graphics_Atlases[i].surface);
 
-		for (Uint8 yc = FONTHEIGHT; yc; yc--, line++, py += s->pitch) {
-			Uint8	col = *line;
-			Uint8	*px = py;
+	memset(Graphics_Atlases, 0, sizeof(Graphics_Atlases));
+}
 
-			for (Uint8 xc = FONTWIDTH; xc; xc--, col >>= 1, px -= bpp)
-				if (col & 1)
-					SAFE_SETPIXEL(px, max, bpp, color);
-		}
+/*
+ * offscreen software surface with the pixel format (and palette) of s
+ */
+
+SDL_Surface *
+Graphics_CreateCompatible(SDL_Surface *s, Uint16 w, Uint16 h)
+{
+	SDL_PixelFormat	*format = s->format;
+	SDL_Surface	*surface;
+
+	if (!(surface = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h,
+					     format->BitsPerPixel,
+					     format->Rmask, format->Gmask,
+					     format->Bmask, format->Amask)))
+		return NULL;
+
+	if (format->palette &&
+	    !SDL_SetColors(surface, format->palette->colors, 0,
+			   format->palette->ncolors)) {
+		SDL_FreeSurface(surface);
+		return NULL;
 	}
 
-	GENERIC_UNLOCK(s);
+	return surface;
 }
 
 int
@@ -173,3 +569,183 @@ Graphics_printf(SDL_Surface *s, Uint16 x, Uint16 y, Uint32 color,
 	       !Graphics_WriteText(s, x, y, buffer, color) ? ret : -1;
 }
 
+
+/*
+ * damage tracking: all rectangles drawn to are collected and flushed with
+ * a single SDL_UpdateRects() per frame. overlapping or adjacent rectangles
+ * are merged if their union does not flush more pixels than both do.
+ */
+
+#define GRAPHICS_DAMAGE_MAX	64
+
+static struct {
+	SDL_Rect	rects[GRAPHICS_DAMAGE_MAX];
+	int		cRects;
+	int		all;		/* whole surface damaged */
+} Graphics_Damaged;
+
+struct Graphics_Stats Graphics_Stats;
+
+static inline int Graphics_Touch(SDL_Rect *a, SDL_Rect *b);
+static inline void Graphics_Union(SDL_Rect *a, SDL_Rect *b);
+static inline int Graphics_Clip(SDL_Surface *s, SDL_Rect *rect);
+
+static inline int
+Graphics_Touch(SDL_Rect *a, SDL_Rect *b)
+{
+	return a->x <= b->x + b->w && b->x <= a->x + a->w &&
+	       a->y <= b->y + b->h && b->y <= a->y + a->h;
+}
+
+/* stores the bounding box of a and b in a */
+static inline void
+Graphics_Union(SDL_Rect *a, SDL_Rect *b)
+{
+	Sint32 x2 = a->x + a->w > b->x + b->w ? a->x + a->w : b->x + b->w;
+	Sint32 y2 = a->y + a->h > b->y + b->h ? a->y + a->h : b->y + b->h;
+
+	if (b->x < a->x)
+		a->x = b->x;
+	if (b->y < a->y)
+		a->y = b->y;
+	a->w = x2 - a->x;
+	a->h = y2 - a->y;
+}
+
+static inline int
+Graphics_Clip(SDL_Surface *s, SDL_Rect *rect)
+{
+	Sint32 x2 = rect->x + rect->w, y2 = rect->y + rect->h;
+
+	if (rect->x < 0)
+		rect->x = 0;
+	if (rect->y < 0)
+		rect->y = 0;
+	if (x2 > s->w)
+		x2 = s->w;
+	if (y2 > s->h)
+		y2 = s->h;
+
+	if (x2 <= rect->x || y2 <= rect->y)
+		return 0;
+
+	rect->w = x2 - rect->x;
+	rect->h = y2 - rect->y;
+	return 1;
+}
+
+/*
+ * rect == NULL damages the whole surface (like SDL_FillRect())
+ */
+
+void
+Graphics_Damage(SDL_Surface *s, SDL_Rect *rect)
+{
+	SDL_Rect r;
+
+	if (Graphics_Damaged.all)
+		return;
+
+	if (!rect) {
+		Graphics_Damaged.all = 1;
+		Graphics_Damaged.cRects = 0;
+		return;
+	}
+
+	r = *rect;
+	if (!Graphics_Clip(s, &r))
+		return;
+
+	for (int i = 0; i < Graphics_Damaged.cRects; i++) {
+		SDL_Rect *d = Graphics_Damaged.rects + i;
+		SDL_Rect u = *d;
+
+		if (!Graphics_Touch(&r, d))
+			continue;
+
+		Graphics_Union(&u, &r);
+		if ((Uint32)u.w*u.h > (Uint32)r.w*r.h + (Uint32)d->w*d->h)
+			continue;
+
+		/* union may touch rectangles checked before */
+		r = u;
+		*d = Graphics_Damaged.rects[--Graphics_Damaged.cRects];
+		i = -1;
+	}
+
+	if (Graphics_Damaged.cRects == GRAPHICS_DAMAGE_MAX) {
+		/* too fragmented: flush the bounding box */
+		for (int i = 0; i < Graphics_Damaged.cRects; i++)
+			Graphics_Union(&r, Graphics_Damaged.rects + i);
+		Graphics_Damaged.cRects = 0;
+	}
+
+	Graphics_Damaged.rects[Graphics_Damaged.cRects++] = r;
+}
+
+void
+Graphics_Flush(SDL_Surface *s)
+{
+	Uint32 pixels = 0;
+
+	if (Graphics_Damaged.all) {
+		SDL_UpdateRect(s, 0, 0, 0, 0);
+
+		pixels = s->w*s->h;
+		Graphics_Stats.rects++;
+	} else if (Graphics_Damaged.cRects) {
+		SDL_UpdateRects(s, Graphics_Damaged.cRects,
+				Graphics_Damaged.rects);
+
+		for (int i = 0; i < Graphics_Damaged.cRects; i++)
+			pixels += Graphics_Damaged.rects[i].w*
+				  Graphics_Damaged.rects[i].h;
+		Graphics_Stats.rects += Graphics_Damaged.cRects;
+	} else
+		return;
+
+	Graphics_Damaged.all = 0;
+	Graphics_Damaged.cRects = 0;
+
+	Graphics_Stats.frames++;
+	Graphics_Stats.pixels += pixels;
+	Graphics_Stats.last_pixels = pixels;
+	if (pixels > Graphics_Stats.max_pixels)
+		Graphics_Stats.max_pixels = pixels;
+}
+
+void
+Graphics_DumpStats(FILE *stream)
+{
+	fprintf(stream, "Frames flushed:\t\t%u\n"
+			"Rectangles flushed:\t%u\n"
+			"Pixels flushed:\t\t%llu\n"
+			"Pixels per frame:\t%llu (max. %u)\n"
+			"Glyph cache hits:\t%u\n"
+			"Glyph cache misses:\t%u\n"
+			"Glyph atlas evictions:\t%u\n",
+		Graphics_Stats.frames, Graphics_Stats.rects,
+		(unsigned long long)Graphics_Stats.pixels,
+		Graphics_Stats.frames ?
+			(unsigned long long)Graphics_Stats.pixels/
+					    Graphics_Stats.frames : 0ULL,
+		Graphics_Stats.max_pixels, Graphics_Stats.glyph_hits,
+		Graphics_Stats.glyph_misses, Graphics_Stats.atlas_evictions);
+
+#ifdef GRAPHICS_PROFILE
+	const char *name = GRAPHICS_PRIMITIVE;
+
+	fprintf(stream, "%-9s %10s %10s %10s\n",
+		"Primitive", "calls", "mean us", "total ms");
+
+	for (int p = 0; p < GRAPHICS_PRIMITIVES;
+	     p++, name += strlen(name) + 1) {
+		struct Graphics_Timing *timing = Graphics_Stats.timings + p;
+
+		fprintf(stream, "%-9s %10u %10.2f %10.1f\n",
+			name, timing->calls,
+			timing->calls ? (double)timing->us/timing->calls : 0.,
+			timing->us/1000.);
+	}
+#endif
+}
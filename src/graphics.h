@@ -2,36 +2,143 @@
 #ifndef __GRAPHICS_H
 #define __GRAPHICS_H
 
+#include <stdio.h>
+
 #include <SDL.h>
 
 #include "controller.h"
 #include "fontface.h"
 		/* ^ defines FONTWIDTH/FONTHEIGHT */
+#ifdef GRAPHICS_PROFILE
+#include "latency.h"
+#endif
+
+enum Graphics_SIMD {
+	GRAPHICS_SIMD_NONE = 0,
+	GRAPHICS_SIMD_SSE2,
+	GRAPHICS_SIMD_AVX2
+};
+#define GRAPHICS_SIMD	\
+	"none\0"	\
+	"sse2\0"	\
+	"avx2\0"
+
+enum Graphics_SIMD Graphics_Init(enum Graphics_SIMD max);
 
 int Graphics_DrawHLine(SDL_Surface *s, Uint16 x, Uint16 y, Uint16 l, Uint32 color);
 int Graphics_DrawVLine(SDL_Surface *s, Uint16 x, Uint16 y, Uint16 l, Uint32 color);
 int Graphics_DrawRect(SDL_Surface *s, SDL_Rect *rect, Uint32 color);
-int Graphics_GradFillRect(SDL_Surface *s, SDL_Rect *rect, Uint16 max,
-			  SDL_Color *top, SDL_Color *bottom, SDL_Color *last);
+int Graphics_GradFillRect(SDL_Surface *s, SDL_Rect *rect, const Uint32 *colors);
 int Graphics_WriteText(SDL_Surface *s, Uint16 x, Uint16 y, const char *text,
 		       Uint32 color);
 int Graphics_printf(SDL_Surface *s, Uint16 x, Uint16 y, Uint32 color,
 		    const char *format, ...);
 
+/*
+ * drawing primitives, timed if compiled with GRAPHICS_PROFILE
+ * (e.g. by bench-render)
+ */
+enum Graphics_Primitive {
+	GRAPHICS_FILL = 0,	/* solid rectangles */
+	GRAPHICS_LINE,		/* lines and outlines */
+	GRAPHICS_GRAD,		/* gradient fills */
+	GRAPHICS_TEXT,
+	GRAPHICS_BLIT,		/* compositing of retained surfaces */
+	GRAPHICS_PRIMITIVES
+};
+#define GRAPHICS_PRIMITIVE	\
+	"fill\0"		\
+	"line\0"		\
+	"grad\0"		\
+	"text\0"		\
+	"blit\0"
+
+extern struct Graphics_Stats {
+	Uint32	frames;		/* flushes */
+	Uint32	rects;
+	Uint64	pixels;
+
+	Uint32	last_pixels;	/* flushed in last frame */
+	Uint32	max_pixels;	/* per frame */
+
+	Uint32	glyph_hits;	/* glyphs blitted from the cache */
+	Uint32	glyph_misses;	/* glyphs rasterized */
+	Uint32	atlas_evictions;
+
+	struct Graphics_Timing {
+		Uint64	us;
+		Uint32	calls;
+	} timings[GRAPHICS_PRIMITIVES];	/* with GRAPHICS_PROFILE only */
+} Graphics_Stats;
+
+#ifdef GRAPHICS_PROFILE
+#define GRAPHICS_PROFILE_START() Uint32 Graphics_Start = Latency_Now()
+#define GRAPHICS_PROFILED(P, R)	Graphics_Account(P, Graphics_Start, R)
+#else
+#define GRAPHICS_PROFILE_START()
+#define GRAPHICS_PROFILED(P, R)	(R)
+#endif
+
+extern struct Graphics_Config {
+	int	glyph_cache;	/* render text from glyph atlases */
+} graphics_config;
+
+void Graphics_FreeGlyphCache(void);
+
+SDL_Surface *Graphics_CreateCompatible(SDL_Surface *s, Uint16 w, Uint16 h);
+
+void Graphics_Damage(SDL_Surface *s, SDL_Rect *rect);
+void Graphics_Flush(SDL_Surface *s);
+void Graphics_DumpStats(FILE *stream);
+
 
+#ifdef GRAPHICS_PROFILE
+static inline int Graphics_Account(enum Graphics_Primitive primitive,
+				   Uint32 start, int r);
+#endif
 static inline int Graphics_BlankRect(SDL_Surface *s, SDL_Rect *rect);
 static inline int Graphics_FillRect(SDL_Surface *s, SDL_Rect *rect, Uint32 color);
+static inline int Graphics_Blit(SDL_Surface *src, SDL_Rect *srcrect,
+				SDL_Surface *dst, SDL_Rect *dstrect);
+
+#ifdef GRAPHICS_PROFILE
+/*
+ * passes through the primitive's result r
+ */
+static inline int
+Graphics_Account(enum Graphics_Primitive primitive, Uint32 start, int r)
+{
+	struct Graphics_Timing *timing = Graphics_Stats.timings + primitive;
+
+	timing->us += Latency_Now() - start;
+	timing->calls++;
+
+	return r;
+}
+#endif
 
 static inline int
 Graphics_BlankRect(SDL_Surface *s, SDL_Rect *rect)
 {
-	return SDL_FillRect(s, rect, display.background);
+	return Graphics_FillRect(s, rect, display.background);
 }
 
 static inline int
 Graphics_FillRect(SDL_Surface *s, SDL_Rect *rect, Uint32 color)
 {
-	return SDL_FillRect(s, rect, color);
+	GRAPHICS_PROFILE_START();
+
+	return GRAPHICS_PROFILED(GRAPHICS_FILL, SDL_FillRect(s, rect, color));
+}
+
+static inline int
+Graphics_Blit(SDL_Surface *src, SDL_Rect *srcrect,
+	      SDL_Surface *dst, SDL_Rect *dstrect)
+{
+	GRAPHICS_PROFILE_START();
+
+	return GRAPHICS_PROFILED(GRAPHICS_BLIT,
+				 SDL_BlitSurface(src, srcrect, dst, dstrect));
 }
 
 #endif
@@ -0,0 +1,123 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#include "controls.h"
+#include "hittest.h"
+
+#define HITTEST_MIN_SHIFT	4	/* 16x16 pixel cells */
+#define HITTEST_MAX_SHIFT	8	/* 256x256 pixel cells */
+
+static inline void HitTest_Bounds(struct Control *c, SDL_Rect *bounds);
+
+/*
+ * area a control can be hit in: a button slider's button moves along the
+ * whole height of the slider (and overlaps its top by the padding), so
+ * its cells do not have to be updated when the value changes
+ */
+
+static inline void
+HitTest_Bounds(struct Control *c, SDL_Rect *bounds)
+{
+	*bounds = c->geo;
+
+	if (c->type == SLIDER && c->u.slider.type == SLIDER_BUTTON) {
+		Uint16 padding = SLIDER_PADDING(c);
+
+		if (padding > bounds->y)
+			padding = bounds->y;
+		bounds->y -= padding;
+		bounds->h += padding;
+	}
+}
+
+int
+HitTest_BuildGrid(struct HitTest_Grid *grid,
+		  struct Control *controls, Uint32 cControls)
+{
+	Uint32	width = 1, height = 1;
+	Uint32	area, cCells;
+
+	HitTest_FreeGrid(grid);
+
+	for (struct Control *c = controls; c < controls + cControls; c++) {
+		SDL_Rect bounds;
+
+		HitTest_Bounds(c, &bounds);
+
+		if (bounds.x + bounds.w + 1 > width)
+			width = bounds.x + bounds.w + 1;
+		if (bounds.y + bounds.h + 1 > height)
+			height = bounds.y + bounds.h + 1;
+	}
+
+	/* about one cell per control */
+	area = width*height/(cControls ? cControls : 1);
+	for (grid->shift = HITTEST_MIN_SHIFT;
+	     grid->shift < HITTEST_MAX_SHIFT &&
+	     1U << 2*(grid->shift + 1) <= area;
+	     grid->shift++);
+
+	grid->cols = ((width - 1) >> grid->shift) + 1;
+	grid->rows = ((height - 1) >> grid->shift) + 1;
+	cCells = grid->cols*grid->rows;
+
+	if (!(grid->cells = calloc(cCells + 1, sizeof(Uint32))))
+		return 1;
+
+	/* count candidates per cell, then fill in registry order */
+	for (int pass = 0; pass < 2; pass++) {
+		for (struct Control *c = controls; c < controls + cControls; c++) {
+			SDL_Rect	bounds;
+			Uint16		col1, col2, row1, row2;
+
+			HitTest_Bounds(c, &bounds);
+			col1 = bounds.x >> grid->shift;
+			col2 = (bounds.x + bounds.w) >> grid->shift;
+			row1 = bounds.y >> grid->shift;
+			row2 = (bounds.y + bounds.h) >> grid->shift;
+
+			for (Uint16 row = row1; row <= row2; row++)
+				for (Uint16 col = col1; col <= col2; col++) {
+					Uint32 cell = row*grid->cols + col;
+
+					if (pass)
+						grid->candidates[grid->cells[cell]++] = c;
+					else
+						grid->cells[cell + 1]++;
+				}
+		}
+
+		if (pass)
+			break;
+
+		for (Uint32 cell = 0; cell < cCells; cell++)
+			grid->cells[cell + 1] += grid->cells[cell];
+
+		grid->candidates = malloc((grid->cells[cCells] + 1)*
+					  sizeof(struct Control *));
+		if (!grid->candidates) {
+			HitTest_FreeGrid(grid);
+			return 1;
+		}
+	}
+
+	/* filling advanced every offset to the start of the next cell */
+	memmove(grid->cells + 1, grid->cells, cCells*sizeof(Uint32));
+	grid->cells[0] = 0;
+
+	return 0;
+}
+
+void
+HitTest_FreeGrid(struct HitTest_Grid *grid)
+{
+	free(grid->cells);
+	free(grid->candidates);
+	memset(grid, 0, sizeof(struct HitTest_Grid));
+}
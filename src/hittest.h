@@ -0,0 +1,65 @@
+#ifndef __HITTEST_H
+#define __HITTEST_H
+
+#include <SDL.h>
+
+#include "controls.h"
+
+/*
+ * uniform grid over the screen mapping each cell to the controls that
+ * may be hit within it (in registry order), stored as one candidate array
+ * indexed by per-cell offsets
+ */
+
+struct HitTest_Grid {
+	Uint8		shift;		/* cells are 1 << shift pixels wide/high */
+	Uint16		cols;
+	Uint16		rows;
+
+	Uint32		*cells;		/* cols*rows + 1 offsets into candidates */
+	struct Control	**candidates;
+};
+
+int HitTest_BuildGrid(struct HitTest_Grid *grid,
+		      struct Control *controls, Uint32 cControls);
+void HitTest_FreeGrid(struct HitTest_Grid *grid);
+
+static inline int HitTest_Control(struct Control *c, Uint16 x, Uint16 y);
+static inline struct Control *HitTest_Lookup(struct HitTest_Grid *grid,
+					     Uint16 x, Uint16 y);
+
+static inline int
+HitTest_Control(struct Control *c, Uint16 x, Uint16 y)
+{
+	if (x < c->geo.x || x > c->geo.x + c->geo.w)
+		return 0;
+
+	if (c->type == SLIDER && c->u.slider.type == SLIDER_BUTTON) {
+		Uint16 button_y = c->u.slider.u.button.button_y;
+
+		return y >= button_y &&
+		       y <= button_y + (SLIDER_PADDING(c) << 1);
+	}
+
+	return y >= c->geo.y && y <= c->geo.y + c->geo.h;
+}
+
+static inline struct Control *
+HitTest_Lookup(struct HitTest_Grid *grid, Uint16 x, Uint16 y)
+{
+	Uint16	col = x >> grid->shift;
+	Uint16	row = y >> grid->shift;
+	Uint32	cell;
+
+	if (col >= grid->cols || row >= grid->rows)
+		return NULL;
+	cell = row*grid->cols + col;
+
+	for (Uint32 i = grid->cells[cell]; i < grid->cells[cell + 1]; i++)
+		if (HitTest_Control(grid->candidates[i], x, y))
+			return grid->candidates[i];
+
+	return NULL;
+}
+
+#endif
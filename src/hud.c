@@ -0,0 +1,95 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <SDL.h>
+
+#include "controller.h"
+#include "graphics.h"
+#include "osc.h"
+#include "atomics.h"
+#include "latency.h"
+#include "hud.h"
+
+/*
+ * head-up display in the bottom line of the screen, showing the rates
+ * since its last update (once per HUD_INTERVAL), so operators can see
+ * whether the controller is falling behind
+ */
+
+struct Hud hud = {
+	.visible = 0
+};
+
+static void Hud_Snapshot(Uint32 now);
+
+/*
+ * counters the next rates are computed from
+ */
+
+static void
+Hud_Snapshot(Uint32 now)
+{
+	hud.ticks = now;
+
+	hud.last_events = hud.events;
+	hud.last_messages = Osc_MessageCount();
+	hud.last_pixels = Graphics_Stats.pixels;
+	Latency_Snapshot(LATENCY_RENDER, &hud.last_render);
+}
+
+/*
+ * returns the new visibility, the screen has to be redrawn when the HUD
+ * is hidden.
+ * the first rates shown cover the time since the HUD was shown.
+ */
+
+int
+Hud_Toggle(void)
+{
+	hud.next = SDL_GetTicks();
+	if (!hud.visible)
+		Hud_Snapshot(hud.next);
+
+	return (hud.visible = !hud.visible);
+}
+
+int
+Hud_Update(SDL_Surface *s)
+{
+	struct Latency_Histogram *render = Latency_Histograms + LATENCY_RENDER;
+
+	Uint32	now = SDL_GetTicks();
+	double	elapsed = now != hud.ticks ? (now - hud.ticks)/1000. : 1.;
+
+	Uint32	messages = Osc_MessageCount();
+	Uint32	redraws = ATOMIC_LOAD(&render->count) - hud.last_render.count;
+
+	SDL_Rect line = {
+		.x = 0,
+		.y = s->h - FONTHEIGHT,
+		.w = s->w,
+		.h = FONTHEIGHT
+	};
+
+	if (Graphics_BlankRect(s, &line) ||
+	    Graphics_printf(s, line.x, line.y, display.foreground,
+			    "%.0f ev/s  %.0f msg/s  queue %u  "
+			    "redraw %u/%u us  %.1f Mpx/s",
+			    (hud.events - hud.last_events)/elapsed,
+			    (messages - hud.last_messages)/elapsed,
+			    Osc_QueueDepth(),
+			    redraws ? (Uint32)((render->sum - hud.last_render.sum)/
+					       redraws) : 0,
+			    Latency_Percentile(LATENCY_RENDER, &hud.last_render,
+					       99),
+			    (Graphics_Stats.pixels - hud.last_pixels)/elapsed/
+			    1000000.) == -1)
+		return 1;
+	Graphics_Damage(s, &line);
+
+	hud.next = now + HUD_INTERVAL;
+	Hud_Snapshot(now);
+
+	return 0;
+}
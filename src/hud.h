@@ -0,0 +1,42 @@
+#ifndef __HUD_H
+#define __HUD_H
+
+#include <SDL.h>
+
+#include "latency.h"
+
+#define HUD_INTERVAL	1000	/* ms between updates */
+
+extern struct Hud {
+	int	visible;
+	Uint32	next;		/* ticks of next update */
+
+	Uint32	events;		/* counted by the main thread */
+
+				/* at last update */
+	Uint32	ticks;
+	Uint32	last_events;
+	Uint32	last_messages;
+	Uint64	last_pixels;
+	struct Latency_Histogram last_render;
+} hud;
+
+int Hud_Toggle(void);
+int Hud_Update(SDL_Surface *s);
+
+static inline int Hud_Due(void);
+static inline void Hud_CountEvent(void);
+
+static inline int
+Hud_Due(void)
+{
+	return hud.visible && (Sint32)(SDL_GetTicks() - hud.next) >= 0;
+}
+
+static inline void
+Hud_CountEvent(void)
+{
+	hud.events++;
+}
+
+#endif
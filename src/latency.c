@@ -0,0 +1,153 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+
+#include <SDL.h>
+
+#include "atomics.h"
+#include "latency.h"
+
+/*
+ * end-to-end latency statistics: the main thread timestamps every input
+ * event when retrieving it from the SDL event queue (SDL 1.2 events carry
+ * no timestamps, so time spent in the queue, e.g. while redrawing, is not
+ * included, but redrawing is recorded itself). OSC packets carry the input
+ * and enqueue times, the OSC thread records the remaining stages.
+ */
+
+struct Latency_Histogram Latency_Histograms[LATENCY_STAGES];
+
+Uint32 Latency_Input;
+
+static volatile sig_atomic_t Latency_DumpRequest = 0;
+
+static inline Uint32 Latency_BucketMax(int bucket);
+static void Latency_SignalHandler(int sig);
+
+/*
+ * largest value recorded in a bucket
+ */
+
+static inline Uint32
+Latency_BucketMax(int bucket)
+{
+	Uint32 width;
+
+	if (bucket < 1 << LATENCY_SUB_BITS)
+		return bucket;
+
+	width = (Uint32)1 << ((bucket >> LATENCY_SUB_BITS) - 1);
+
+	return ((bucket & ((1 << LATENCY_SUB_BITS) - 1)) +
+		(1 << LATENCY_SUB_BITS))*width + width - 1;
+}
+
+void
+Latency_Snapshot(enum Latency_Stage stage, struct Latency_Histogram *snapshot)
+{
+	struct Latency_Histogram *h = Latency_Histograms + stage;
+
+	snapshot->count = ATOMIC_LOAD(&h->count);
+	snapshot->sum = ATOMIC_LOAD(&h->sum);
+	snapshot->max = ATOMIC_LOAD(&h->max);
+
+	for (int b = 0; b < LATENCY_BUCKETS; b++)
+		snapshot->buckets[b] = ATOMIC_LOAD(h->buckets + b);
+}
+
+/*
+ * upper bound of the p-th percentile (0 < p <= 100) of the values recorded
+ * since a snapshot (or of all values if NULL)
+ */
+
+Uint32
+Latency_Percentile(enum Latency_Stage stage,
+		   const struct Latency_Histogram *since, double p)
+{
+	struct Latency_Histogram *h = Latency_Histograms + stage;
+
+	Uint32	count = ATOMIC_LOAD(&h->count);
+	Uint32	max = ATOMIC_LOAD(&h->max);
+	double	rank;
+	Uint32	seen = 0;
+
+	if (since)
+		count -= since->count;
+	if (!count)
+		return 0;
+	rank = p/100.*count;
+
+	for (int b = 0; b < LATENCY_BUCKETS; b++) {
+		seen += ATOMIC_LOAD(h->buckets + b);
+		if (since)
+			seen -= since->buckets[b];
+
+		if (seen >= rank) {
+			Uint32 us = Latency_BucketMax(b);
+
+			return us < max ? us : max;
+		}
+	}
+
+	return max;
+}
+
+void
+Latency_Dump(FILE *stream)
+{
+	const char *name = LATENCY_STAGE;
+
+	fprintf(stream, "%-8s %10s %10s %10s %10s %10s %10s %10s\n",
+		"Latency", "count", "mean us", "p50", "p90", "p99", "p99.9",
+		"max");
+
+	for (int stage = 0; stage < LATENCY_STAGES;
+	     stage++, name += strlen(name) + 1) {
+		struct Latency_Histogram *h = Latency_Histograms + stage;
+		Uint32 count = ATOMIC_LOAD(&h->count);
+
+		fprintf(stream, "%-8s %10u %10.0f %10u %10u %10u %10u %10u\n",
+			name, count, count ? (double)h->sum/count : 0.,
+			Latency_Percentile(stage, NULL, 50),
+			Latency_Percentile(stage, NULL, 90),
+			Latency_Percentile(stage, NULL, 99),
+			Latency_Percentile(stage, NULL, 99.9),
+			ATOMIC_LOAD(&h->max));
+	}
+}
+
+static void
+Latency_SignalHandler(int sig)
+{
+	(void)sig;
+
+	Latency_DumpRequest = 1;
+}
+
+/*
+ * statistics may be requested with SIGUSR1, where available
+ */
+
+int
+Latency_InitSignal(void)
+{
+#ifdef SIGUSR1
+	return signal(SIGUSR1, Latency_SignalHandler) == SIG_ERR;
+#else
+	return 0;
+#endif
+}
+
+int
+Latency_DumpRequested(void)
+{
+	if (!Latency_DumpRequest)
+		return 0;
+
+	Latency_DumpRequest = 0;
+	return 1;
+}
@@ -0,0 +1,111 @@
+#ifndef __LATENCY_H
+#define __LATENCY_H
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include <SDL.h>
+
+#include "atomics.h"
+
+/*
+ * latency of the stages between receiving an input event and sending the
+ * resulting OSC message (and of redrawing) in microseconds
+ */
+enum Latency_Stage {
+	LATENCY_HANDLE = 0,	/* input event received -> message enqueued */
+	LATENCY_QUEUE,		/* enqueued -> dequeued by OSC thread */
+	LATENCY_SEND,		/* dequeued -> sent */
+	LATENCY_TOTAL,		/* input event received -> sent */
+	LATENCY_RENDER,		/* redraw of queued controls */
+	LATENCY_STAGES
+};
+#define LATENCY_STAGE	\
+	"handle\0"	\
+	"queue\0"	\
+	"send\0"	\
+	"total\0"	\
+	"render\0"
+
+/*
+ * log-linear (HDR-style) histograms: every power of two is divided into
+ * 2^LATENCY_SUB_BITS buckets, i.e. values are recorded with a precision
+ * of 12.5%.
+ * every histogram is written by a single thread but may be read by others.
+ */
+#define LATENCY_SUB_BITS	3
+#define LATENCY_BUCKETS		((32 - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+extern struct Latency_Histogram {
+	volatile Uint32	count;
+	volatile Uint64	sum;
+	volatile Uint32	max;
+
+	volatile Uint32	buckets[LATENCY_BUCKETS];
+} Latency_Histograms[LATENCY_STAGES];
+
+/* time the event currently handled by the main thread was received */
+extern Uint32 Latency_Input;
+
+static inline Uint32 Latency_Now(void);
+static inline int Latency_Bucket(Uint32 us);
+static inline void Latency_Record(enum Latency_Stage stage, Uint32 us);
+
+void Latency_Snapshot(enum Latency_Stage stage,
+		      struct Latency_Histogram *snapshot);
+Uint32 Latency_Percentile(enum Latency_Stage stage,
+			  const struct Latency_Histogram *since, double p);
+void Latency_Dump(FILE *stream);
+
+int Latency_InitSignal(void);
+int Latency_DumpRequested(void);
+
+/*
+ * monotonic time in microseconds, wrapping around after ~71 minutes
+ */
+
+static inline Uint32
+Latency_Now(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (Uint32)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (Uint32)tv.tv_sec*1000000 + tv.tv_usec;
+#endif
+}
+
+static inline int
+Latency_Bucket(Uint32 us)
+{
+	int e = LATENCY_SUB_BITS;
+
+	if (us < 1 << LATENCY_SUB_BITS)
+		return us;
+
+	while (e < 31 && us >> (e + 1))
+		e++;
+
+	return (e - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS |
+	       (us >> (e - LATENCY_SUB_BITS) & ((1 << LATENCY_SUB_BITS) - 1));
+}
+
+static inline void
+Latency_Record(enum Latency_Stage stage, Uint32 us)
+{
+	struct Latency_Histogram *h = Latency_Histograms + stage;
+
+	ATOMIC_ADD(h->buckets + Latency_Bucket(us), 1);
+	ATOMIC_ADD(&h->sum, us);
+	if (us > h->max)
+		ATOMIC_STORE(&h->max, us);	/* single writer */
+	ATOMIC_ADD(&h->count, 1);
+}
+
+#endif
@@ -0,0 +1,200 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+/*
+ * local UDP sink capturing the OSC datagrams sent by the controller, e.g.
+ * while replaying an input event recording.
+ * it may subscribe to a multicast group, several sinks can share a port.
+ * datagrams are written to a file, each prefixed by its size as 32 bit
+ * integer in network byte order (like OSC 1.0 stream framing), so the
+ * output of different builds can be compared with cmp(1).
+ * terminates when no datagram has been received for a while after the
+ * first one and prints the number of datagrams and the throughput.
+ */
+
+#define SINK_PORT	77777
+#define SINK_IDLE	2	/* s */
+#define SINK_MAX	65536	/* max. datagram size */
+#define SINK_RCVBUF	(1 << 20) /* bytes, to survive bursts */
+
+static inline double
+Now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec*1000. + tv.tv_usec/1000.;
+}
+
+static void
+Usage(const char *name)
+{
+	printf("Usage: %s [-h] [-p PORT] [-g GROUP [-i ADDRESS]] [-o FILE] "
+	       "[-t SECONDS]\n"
+	       "\t-h\t\tShow this help\n"
+	       "\t-p PORT\t\tPort to receive on (default: %d)\n"
+	       "\t-g GROUP\tJoin multicast GROUP\n"
+	       "\t-i ADDRESS\tAddress of interface to join on\n"
+	       "\t-o FILE\t\tWrite datagrams to FILE\n"
+	       "\t-t SECONDS\tTerminate when idle for SECONDS (default: %d)\n",
+	       name, SINK_PORT, SINK_IDLE);
+}
+
+int
+main(int argc, char **argv)
+{
+	static char		buffer[SINK_MAX];
+
+	struct sockaddr_in	addr;
+	int			fd, opt;
+	int			rcvbuf = SINK_RCVBUF;
+
+	int			port = SINK_PORT;
+	FILE			*out = NULL;
+
+	struct ip_mreq		mreq;
+	int			reuse = 1;
+	char			*group = NULL;
+	char			*iface = NULL;
+
+	struct timeval timeout = {
+		.tv_sec = SINK_IDLE,
+		.tv_usec = 0
+	};
+
+	unsigned long		datagrams = 0;
+	unsigned long long	bytes = 0;
+	double			first = 0, last = 0;
+
+	while ((opt = getopt(argc, argv, "hp:g:i:o:t:")) != -1)
+		switch (opt) {
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'g':
+			group = optarg;
+			break;
+		case 'i':
+			iface = optarg;
+			break;
+		case 'o':
+			if (!(out = fopen(optarg, "wb"))) {
+				perror(optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 't':
+			timeout.tv_sec = atoi(optarg);
+			break;
+		case 'h':
+			Usage(*argv);
+			return EXIT_SUCCESS;
+		default:
+			Usage(*argv);
+			return EXIT_FAILURE;
+		}
+
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+		perror("socket");
+		return EXIT_FAILURE;
+	}
+
+	/* the kernel may limit the size, which is not fatal */
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	if (group && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR,
+				&reuse, sizeof(reuse))) {
+		perror("setsockopt");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	memset(&addr, 0, sizeof(struct sockaddr_in));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_in)) < 0) {
+		perror("bind");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	if (group) {
+		mreq.imr_multiaddr.s_addr = inet_addr(group);
+		mreq.imr_interface.s_addr = iface ? inet_addr(iface)
+						  : htonl(INADDR_ANY);
+
+		if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+			       &mreq, sizeof(mreq))) {
+			perror("IP_ADD_MEMBERSHIP");
+			close(fd);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (;;) {
+		ssize_t		r = recv(fd, buffer, sizeof(buffer), 0);
+		unsigned int	size;
+
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break; /* idle */
+
+			perror("recv");
+			close(fd);
+			return EXIT_FAILURE;
+		}
+
+		last = Now();
+		if (!datagrams++) {
+			first = last;
+
+			/* wait indefinitely for the first datagram only */
+			if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+				       sizeof(struct timeval))) {
+				perror("setsockopt");
+				close(fd);
+				return EXIT_FAILURE;
+			}
+		}
+		bytes += r;
+
+		size = htonl(r);
+		if (out && (fwrite(&size, sizeof(size), 1, out) != 1 ||
+			    fwrite(buffer, r, 1, out) != 1)) {
+			perror("fwrite");
+			close(fd);
+			return EXIT_FAILURE;
+		}
+	}
+
+	close(fd);
+	if (out && fclose(out)) {
+		perror("fclose");
+		return EXIT_FAILURE;
+	}
+
+	printf("Datagrams received:\t%lu\n"
+	       "Bytes received:\t\t%llu\n"
+	       "Duration:\t\t%.1f ms\n"
+	       "Datagrams per second:\t%.0f\n",
+	       datagrams, bytes, last - first,
+	       last > first ? datagrams/(last - first)*1000. : 0.);
+
+	return EXIT_SUCCESS;
+}
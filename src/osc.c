@@ -4,6 +4,7 @@
 #endif
 
 #include <stdarg.h>
+#include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,6 +17,12 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#ifdef HAVE_SYS_UN_H
+#include <sys/un.h>
+#endif
+#ifdef HAVE_SENDMMSG
+#include <sys/uio.h>
+#endif
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -25,28 +32,167 @@
 #include <SDL_thread.h>
 
 #include "controller.h"
+#include "atomics.h"
+#include "latency.h"
 #include "OSC-client.h"
 #include "osc.h"
+#ifdef HAVE_SHM_OPEN
+#include "ring.h"
+#endif
+
+/*
+ * every destination has its own sending thread and lock-free
+ * single-producer (main thread)/single-consumer (OSC thread) ring buffer.
+ * the consumer only sleeps on the semaphore if it found the queue empty
+ * and the producer only posts it if the consumer announced to do so.
+ *
+ * messages are encoded once into a reference-counted packet of a pool
+ * owned by the main thread, which is queued for all destinations. a packet
+ * is reused when every destination has sent it, so a slow destination
+ * only drops its own messages when its queue is full.
+ *
+ * shared memory ring destinations ("shm:NAME") have no thread: messages
+ * are encoded by the main thread directly into the ring's next slot.
+ */
+
+#define OSC_QUEUE_SIZE	1024		/* must be a power of 2 */
+#define OSC_POOL_SIZE	(2*OSC_QUEUE_SIZE) /* must be a power of 2 */
+#define OSC_PACKET_SIZE	256
+#define OSC_BUNDLE_SIZE	1472		/* Ethernet MTU - IP/UDP headers */
+#define OSC_STRING_SIZE	32		/* max. size of formatted values */
+
+#define QUEUE_SLOT(Q, I) ((Q)->ring[(I) & (OSC_QUEUE_SIZE - 1)])
+
+#if defined(HAVE_SHM_OPEN) && OSC_PACKET_SIZE > RING_PACKET_SIZE
+#error "OSC packets don't fit into ring slots"
+#endif
+
+static struct Osc_Packet {
+	volatile int		refs;	  /* queues holding the packet */
+
+	struct Osc_Template	*pending; /* coalesced update or NULL */
+	volatile int		claimed;  /* encoding of update claimed */
+	volatile int		ready;	  /* data encoded */
+
+	Uint64			timetag;  /* input time */
+
+	Uint32			input;	  /* s.a. Latency_Now() */
+	Uint32			enqueued;
+
+	Uint32			size;
+	char			data[OSC_PACKET_SIZE];
+} Osc_Pool[OSC_POOL_SIZE];
+
+static Uint32 Osc_PoolNext = 0;	/* main thread only */
+
+/*
+ * datagrams to send with a single system call, only accessed by the OSC
+ * thread of a destination
+ */
+
+#define OSC_BATCH_SIZE	64
+
+struct Osc_Batch {
+	struct Osc_Datagram {
+		char	*data;
+		Uint32	size;
+
+		Uint32	end;		/* queue position after datagram */
+		Uint32	messages;	/* OSC messages in datagram */
+	} dgram[OSC_BATCH_SIZE];
+	Uint32 count;
+
+	Uint32 start;		/* queue position of first message */
+	Uint32 dequeued;	/* s.a. Latency_Now() */
+
+	Uint32 bundles[OSC_BATCH_SIZE][OSC_BUNDLE_SIZE/sizeof(Uint32)];
+
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr	msgs[OSC_BATCH_SIZE];
+	struct iovec	iov[OSC_BATCH_SIZE];
+#endif
+};
+
+static struct Osc_Destination {
+	int		fd;
+	SDL_Thread	*thread;
+
+	struct Osc_Queue {
+		struct Osc_Packet *ring[OSC_QUEUE_SIZE];
 
-#define FOREACH_QUEUE(VAR) \
-	for (struct Osc_QueueElement *VAR = Osc_QueueHead.next; VAR; VAR = VAR->next)
+		volatile Uint32	head;	/* written by producer only */
+		volatile Uint32	tail;	/* written by consumer only */
 
-static struct Osc_QueueElement {
-	struct Osc_QueueElement *next;
+		volatile int	idle;	/* consumer waits for semaphore */
+		volatile int	terminate;
 
-	OSCbuf buffer;
-} Osc_QueueHead = {NULL};
+		SDL_sem		*semaphore;
+	} queue;
 
-static struct Osc_QueueElement *Osc_QueueTail = &Osc_QueueHead;
+	struct Osc_Batch	batch;
+	struct Osc_Stats	stats;
+} Osc_Destinations[OSC_DESTINATIONS];
 
-static SDL_mutex *Osc_QueueMutex = NULL;
-static SDL_sem *Osc_QueueSemaphore = NULL;
+static int Osc_cDestinations = 0;
 
+static struct Osc_Ring {
+	struct Ring		*ring;
+	struct Osc_Stats	stats;
+} Osc_Rings[OSC_DESTINATIONS];
+
+static int Osc_cRings = 0;
+
+struct Osc_Config osc_config = {
+	.coalesce = 0,
+	.bundle = 0,
+	.bundle_delay = 0,
+
+	.stats = 0,
+
+	.multicast_ttl = 1,
+	.multicast_loop = 1,
+	.multicast_if = NULL
+};
+
+static int Osc_ConnectUnix(const char *path);
+static int Osc_AddRing(const char *name);
+static int Osc_InitThread(int fd);
 static int SDLCALL Osc_DequeueThread(void *ud);
 
+static inline int Osc_WakeupThread(struct Osc_Queue *queue);
+static inline int Osc_WaitQueue(struct Osc_Queue *queue);
+static inline void Osc_WaitBundle(struct Osc_Destination *dest);
+static inline void Osc_ResolvePacket(struct Osc_Packet *packet);
+static inline void Osc_AddDatagram(struct Osc_Batch *batch, char *data,
+				   Uint32 size, Uint32 end, Uint32 messages);
+static inline void Osc_CollectPackets(struct Osc_Destination *dest,
+				      Uint32 head);
+static inline void Osc_CollectBundles(struct Osc_Destination *dest,
+				      Uint32 head);
+static inline int Osc_BatchBucket(Uint32 messages);
+static inline void Osc_ReleasePackets(struct Osc_Destination *dest,
+				      Uint32 start, Uint32 end, Uint32 sent);
+static inline int Osc_SendBatch(struct Osc_Destination *dest);
+static inline Uint64 Osc_TimeTag(void);
+static inline void Osc_StampPacket(struct Osc_Packet *packet);
+static inline struct Osc_Packet *Osc_AllocPacket(void);
+static inline int Osc_PushPacket(struct Osc_Packet *packet);
+static inline void Osc_Put32(char *p, Uint32 v);
+static inline void Osc_Put64(char *p, Uint64 v);
+static inline Uint32 Osc_MaxSize(const struct Osc_Template *tmpl);
+static inline Uint32 Osc_Encode(char *data, const struct Osc_Template *tmpl,
+				double value);
+static inline void Osc_WriteRings(const struct Osc_Template *tmpl,
+				  double value);
+
 static inline Uint32 Osc_StrPad32(Uint32 l);
-static inline int Osc_BuildFloatMessage(OSCbuf *buf, const char *address,
-					float value);
+
+/*
+ * a single datagram sent to a multicast group reaches all of its
+ * subscribers.
+ * "unix:PATH" connects to a Unix domain datagram socket instead, avoiding
+ * the IP stack for receivers on the same host.
+ */
 
 int
 Osc_Connect(const char *hostname, int port)
@@ -56,6 +202,9 @@ Osc_Connect(const char *hostname, int port)
 
 	int			fd;
 
+	if (!strncmp(hostname, OSC_UNIX_PREFIX, sizeof(OSC_UNIX_PREFIX) - 1))
+		return Osc_ConnectUnix(hostname + sizeof(OSC_UNIX_PREFIX) - 1);
+
 	if (!(entry = gethostbyname(hostname)) ||
 	    (fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
 		return -1;
@@ -65,6 +214,27 @@ Osc_Connect(const char *hostname, int port)
 	addr.sin_addr.s_addr = *(in_addr_t*)*entry->h_addr_list;
 	addr.sin_port = htons(port);
 
+#ifdef IP_MULTICAST_TTL
+	if (IN_MULTICAST(ntohl(addr.sin_addr.s_addr))) {
+		/* BSD stacks expect single bytes */
+		unsigned char	ttl = osc_config.multicast_ttl;
+		unsigned char	loop = osc_config.multicast_loop;
+		struct in_addr	iface;
+
+		if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL,
+			       &ttl, sizeof(ttl)) ||
+		    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP,
+			       &loop, sizeof(loop)) ||
+		    Osc_MulticastInterface(&iface) ||
+		    (iface.s_addr != htonl(INADDR_ANY) &&
+		     setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF,
+				&iface, sizeof(iface)))) {
+			close(fd);
+			return -1;
+		}
+	}
+#endif
+
 	if (connect(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_in)) < 0) {
 		close(fd);
 		return -1;
@@ -73,52 +243,542 @@ Osc_Connect(const char *hostname, int port)
 	return fd;
 }
 
-SDL_Thread *
-Osc_InitThread(int *fd)
+static int
+Osc_ConnectUnix(const char *path)
 {
-	SDL_Thread *thread;
+#ifdef HAVE_SYS_UN_H
+	struct sockaddr_un	addr;
+	int			fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path) ||
+	    (fd = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0)
+		return -1;
 
-	if (!(Osc_QueueMutex = SDL_CreateMutex()))
-		return NULL;
+	memset(&addr, 0, sizeof(struct sockaddr_un));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
 
-	if (!(Osc_QueueSemaphore = SDL_CreateSemaphore(0))) {
-		SDL_DestroyMutex(Osc_QueueMutex);
-		return NULL;
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_un)) < 0) {
+		close(fd);
+		return -1;
 	}
 
-	if (!(thread = SDL_CreateThread(Osc_DequeueThread, fd))) {
-		SDL_DestroyMutex(Osc_QueueMutex);
-		SDL_DestroySemaphore(Osc_QueueSemaphore);
+	return fd;
+#else
+	return -1;
+#endif
+}
+
+/*
+ * interface to send to and join multicast groups on, INADDR_ANY lets the
+ * system choose
+ */
+
+int
+Osc_MulticastInterface(struct in_addr *iface)
+{
+	iface->s_addr = osc_config.multicast_if ?
+				inet_addr(osc_config.multicast_if) :
+				htonl(INADDR_ANY);
+
+	return iface->s_addr == INADDR_NONE;
+}
+
+/*
+ * connect to a comma-separated list of destinations (HOST[:PORT],
+ * unix:PATH or shm:NAME) and start their sending threads. the port of a
+ * host without one is taken from the corresponding element of a
+ * comma-separated list of ports, the last of which applies to all remaining
+ * destinations.
+ */
+
+int
+Osc_AddDestinations(const char *hosts, const char *ports)
+{
+	char	*list, *host, *p;
+	int	port = 0;		/* of the list of ports */
+	int	dest_port;
+	int	fd;
+
+	if (!(list = strdup(hosts)))
+		return 1;
+
+	for (host = strtok(list, ","); host; host = strtok(NULL, ",")) {
+		if (*ports) {
+			port = strtoul(ports, &p, 10);
+			if (*p && *p != ',')
+				goto err;
+			ports = *p ? p + 1 : p;
+		}
+
+		if (!strncmp(host, OSC_SHM_PREFIX,
+			     sizeof(OSC_SHM_PREFIX) - 1)) {
+			if (Osc_AddRing(host + sizeof(OSC_SHM_PREFIX) - 1))
+				goto err;
+			continue;
+		}
+
+		if (!strncmp(host, OSC_UNIX_PREFIX,
+			     sizeof(OSC_UNIX_PREFIX) - 1))
+			dest_port = 0;
+		else if ((p = strrchr(host, ':'))) {
+			*p++ = '\0';
+			dest_port = strtoul(p, &p, 10);
+			if (*p)
+				goto err;
+		} else
+			dest_port = port;
+
+		if ((fd = Osc_Connect(host, dest_port)) < 0)
+			goto err;
+		if (Osc_InitThread(fd)) {
+			Osc_Disconnect(fd);
+			goto err;
+		}
 	}
 
-	return thread;
+	free(list);
+	return 0;
+
+err:
+	free(list);
+	return 1;
 }
 
 /*
- * terminate thread without killing it by freeing the remaining queue and
- * increasing the semaphore (gentle termination condition)
+ * socket of the first (non-ring) destination or -1 if there is none
  */
 
 int
-Osc_TerminateThread(void)
+Osc_Socket(void)
 {
-	struct Osc_QueueElement *next;
+	return Osc_cDestinations ? Osc_Destinations->fd : -1;
+}
 
-	if (SDL_LockMutex(Osc_QueueMutex))
-		return -1;
+/*
+ * create the shared memory object, replacing a stale one of a previous
+ * controller
+ */
+
+static int
+Osc_AddRing(const char *name)
+{
+#ifdef HAVE_SHM_OPEN
+	struct Osc_Ring *ring = Osc_Rings + Osc_cRings;
+
+	if (Osc_cRings == OSC_DESTINATIONS)
+		return 1;
+
+	memset(ring, 0, sizeof(struct Osc_Ring));
+	if (!(ring->ring = Ring_Create(name)))
+		return 1;
+
+	Osc_cRings++;
+	return 0;
+#else
+	return 1;
+#endif
+}
+
+static int
+Osc_InitThread(int fd)
+{
+	struct Osc_Destination *dest = Osc_Destinations + Osc_cDestinations;
+
+	if (Osc_cDestinations == OSC_DESTINATIONS)
+		return 1;
+#ifdef ATOMIC_SPSC_ONLY
+	/* packets cannot be shared by several threads */
+	if (Osc_cDestinations)
+		return 1;
+#endif
+
+	memset(dest, 0, sizeof(struct Osc_Destination));
+	dest->fd = fd;
+
+	if (!(dest->queue.semaphore = SDL_CreateSemaphore(0)))
+		return 1;
+
+	if (!(dest->thread = SDL_CreateThread(Osc_DequeueThread, dest))) {
+		SDL_DestroySemaphore(dest->queue.semaphore);
+		dest->queue.semaphore = NULL;
+		return 1;
+	}
+
+	Osc_cDestinations++;
+	return 0;
+}
+
+/*
+ * terminate the threads of all destinations without killing them by
+ * setting the termination flag and increasing the semaphore (gentle
+ * termination condition), wait for them and disconnect.
+ * afterwards no thread references packets or templates anymore, while
+ * the statistics are kept.
+ * remaining queue elements are discarded, while ring consumers may still
+ * read theirs.
+ */
+
+int
+Osc_TerminateThreads(void)
+{
+	int r = 0;
+
+	for (int d = 0; d < Osc_cDestinations; d++) {
+		struct Osc_Destination *dest = Osc_Destinations + d;
+
+		if (!dest->thread || ATOMIC_LOAD(&dest->queue.terminate))
+			continue;
+
+		ATOMIC_STORE(&dest->queue.terminate, 1);
+		shutdown(dest->fd, SHUT_WR);	/* fail blocked sends */
+		if (SDL_SemPost(dest->queue.semaphore)) {
+			/* cannot be woken up, so don't wait for it */
+			dest->thread = NULL;
+			r = 1;
+		}
+	}
+
+	for (int d = 0; d < Osc_cDestinations; d++) {
+		struct Osc_Destination *dest = Osc_Destinations + d;
+
+		if (!dest->thread)
+			continue;
+
+		SDL_WaitThread(dest->thread, NULL);
+		dest->thread = NULL;
+
+		/* may still be posted until the thread has terminated */
+		SDL_DestroySemaphore(dest->queue.semaphore);
+		dest->queue.semaphore = NULL;
+
+		close(dest->fd);
+		dest->fd = -1;
+	}
+
+#ifdef HAVE_SHM_OPEN
+	for (int i = 0; i < Osc_cRings; i++)
+		if (Osc_Rings[i].ring) {
+			Ring_Destroy(Osc_Rings[i].ring);
+			Osc_Rings[i].ring = NULL;
+		}
+#endif
+
+	return r;
+}
+
+static inline int
+Osc_WakeupThread(struct Osc_Queue *queue)
+{
+	ATOMIC_FENCE();	/* publish head before checking the idle flag */
+
+	return ATOMIC_EXCHANGE(&queue->idle, 0) &&
+	       SDL_SemPost(queue->semaphore);
+}
+
+/*
+ * wait until the queue is non-empty, returns 1 on termination request and
+ * -1 on error
+ */
+
+static inline int
+Osc_WaitQueue(struct Osc_Queue *queue)
+{
+	for (;;) {
+		if (ATOMIC_LOAD(&queue->terminate))
+			return 1;
+		if (ATOMIC_LOAD(&queue->head) != queue->tail)
+			return 0;
+
+		ATOMIC_EXCHANGE(&queue->idle, 1);
+		ATOMIC_FENCE();	/* announce idle state before rechecking head */
+
+		if (ATOMIC_LOAD(&queue->head) != queue->tail) {
+			/* may leave a spurious post, which is harmless */
+			ATOMIC_EXCHANGE(&queue->idle, 0);
+			return 0;
+		}
+
+		if (SDL_SemWait(queue->semaphore))
+			return -1;
+	}
+}
+
+/*
+ * give the main thread at most bundle_delay ms to queue more messages, but
+ * stop waiting as soon as the queued messages fill a bundle.
+ * coalesced updates are not encoded yet, so their maximum size is assumed.
+ */
+
+static inline void
+Osc_WaitBundle(struct Osc_Destination *dest)
+{
+	struct Osc_Queue	*queue = &dest->queue;
+	Uint32			deadline = SDL_GetTicks() + osc_config.bundle_delay;
+	Uint32			tail = queue->tail;
+	Uint32			size = 16;	/* bundle header */
+
+	for (;;) {
+		Uint32	head = ATOMIC_LOAD(&queue->head);
+		Sint32	left;
+
+		for (; tail != head; tail++) {
+			struct Osc_Packet *packet = QUEUE_SLOT(queue, tail);
+
+			size += sizeof(Uint32) +
+				(packet->pending && !ATOMIC_LOAD(&packet->ready)
+					? Osc_MaxSize(packet->pending)
+					: packet->size);
+		}
+
+		if (size >= OSC_BUNDLE_SIZE || ATOMIC_LOAD(&queue->terminate) ||
+		    (left = deadline - SDL_GetTicks()) <= 0)
+			return;
+
+		ATOMIC_EXCHANGE(&queue->idle, 1);
+		ATOMIC_FENCE();	/* announce idle state before rechecking head */
+
+		if (ATOMIC_LOAD(&queue->head) == head &&
+		    SDL_SemWaitTimeout(queue->semaphore, left) < 0)
+			return;
+
+		/* a post after the timeout is left, which is harmless */
+		ATOMIC_EXCHANGE(&queue->idle, 0);
+	}
+}
+
+/*
+ * coalesced updates are encoded by the first destination thread to send
+ * them, the others wait until it is done
+ */
+
+static inline void
+Osc_ResolvePacket(struct Osc_Packet *packet)
+{
+	struct Osc_Template *tmpl = packet->pending;
+
+	union {
+		double	d;
+		Uint64	i;
+	} arg;
+
+	if (ATOMIC_LOAD(&packet->ready))
+		return;
+
+	if (ATOMIC_EXCHANGE(&packet->claimed, 1)) {
+		/* yield, the encoding thread may share our CPU */
+		while (!ATOMIC_LOAD(&packet->ready))
+			SDL_Delay(0);
+		return;
+	}
+
+	/*
+	 * clear the flag before fetching the value, so a concurrent
+	 * update is either sent now or queued again
+	 */
+	ATOMIC_EXCHANGE(&tmpl->queued, 0);
+	arg.i = ATOMIC_LOAD(&tmpl->value);
+	packet->size = Osc_Encode(packet->data, tmpl, arg.d);
+
+	ATOMIC_STORE(&packet->ready, 1);
+}
+
+static inline void
+Osc_AddDatagram(struct Osc_Batch *batch, char *data, Uint32 size, Uint32 end,
+		Uint32 messages)
+{
+	Uint32 i = batch->count++;
+
+	batch->dgram[i].data = data;
+	batch->dgram[i].size = size;
+	batch->dgram[i].end = end;
+	batch->dgram[i].messages = messages;
+}
+
+/*
+ * collect queued messages up to the given head position, one datagram each
+ */
+
+static inline void
+Osc_CollectPackets(struct Osc_Destination *dest, Uint32 head)
+{
+	struct Osc_Batch *batch = &dest->batch;
+
+	batch->count = 0;
+	batch->start = dest->queue.tail;
+	batch->dequeued = Latency_Now();
+
+	for (Uint32 tail = dest->queue.tail;
+	     tail != head && batch->count < OSC_BATCH_SIZE; tail++) {
+		struct Osc_Packet *packet = QUEUE_SLOT(&dest->queue, tail);
+
+		Osc_ResolvePacket(packet);
+		Osc_AddDatagram(batch, packet->data, packet->size, tail + 1, 1);
+	}
+}
+
+/*
+ * pack queued messages up to the given head position into as few bundles
+ * as possible, each fitting into a single Ethernet frame.
+ * every bundle is stamped with the input time of its first message.
+ */
+
+static inline void
+Osc_CollectBundles(struct Osc_Destination *dest, Uint32 head)
+{
+	struct Osc_Batch	*batch = &dest->batch;
+	Uint32			tail = dest->queue.tail;
+
+	batch->count = 0;
+	batch->start = tail;
+	batch->dequeued = Latency_Now();
+
+	while (tail != head && batch->count < OSC_BATCH_SIZE) {
+		Uint32	*bundle = batch->bundles[batch->count];
+		char	*p = (char *)(bundle + 4);
+		Uint32	messages = 0;
+
+		struct Osc_Packet *packet = QUEUE_SLOT(&dest->queue, tail);
+
+		memcpy(bundle, "#bundle", 8);
+		bundle[2] = htonl(packet->timetag >> 32);
+		bundle[3] = htonl(packet->timetag);
+
+		for (; tail != head; tail++, messages++) {
+			packet = QUEUE_SLOT(&dest->queue, tail);
+			Osc_ResolvePacket(packet);
+
+			if (p + sizeof(Uint32) + packet->size >
+					(char *)bundle + OSC_BUNDLE_SIZE)
+				break;
+
+			*(Uint32 *)p = htonl(packet->size);
+			memcpy(p + sizeof(Uint32), packet->data, packet->size);
+			p += sizeof(Uint32) + packet->size;
+		}
+
+		Osc_AddDatagram(batch, (char *)bundle, p - (char *)bundle,
+				tail, messages);
+	}
+}
+
+/*
+ * histogram bucket: 1, 2-3, 4-7, ... messages per system call
+ */
+
+static inline int
+Osc_BatchBucket(Uint32 messages)
+{
+	int b = 0;
 
-	for (struct Osc_QueueElement *el = Osc_QueueHead.next; el; el = next) {
-		next = el->next;
+	while ((messages >>= 1) && b < OSC_STATS_BUCKETS - 1)
+		b++;
 
-		free(OSC_getPacket(&el->buffer));
-		free(el);
+	return b;
+}
+
+/*
+ * drop the references to the packets in the queue slots [start, end) after
+ * they have been sent.
+ * latencies are recorded for the first destination only, so every message
+ * is counted once.
+ */
+
+static inline void
+Osc_ReleasePackets(struct Osc_Destination *dest, Uint32 start, Uint32 end,
+		   Uint32 sent)
+{
+	Uint32 dequeued = dest->batch.dequeued;
+
+	for (; start != end; start++) {
+		struct Osc_Packet *packet = QUEUE_SLOT(&dest->queue, start);
+
+		if (dest == Osc_Destinations) {
+			Latency_Record(LATENCY_QUEUE, dequeued - packet->enqueued);
+			Latency_Record(LATENCY_SEND, sent - dequeued);
+			Latency_Record(LATENCY_TOTAL, sent - packet->input);
+		}
+
+		ATOMIC_SUB_RELEASE(&packet->refs, 1);
 	}
+}
+
+/*
+ * wait for the socket to become writable and send all collected datagrams,
+ * using a single system call if possible.
+ * queue slots are released as soon as their datagrams have been sent.
+ */
 
-	Osc_QueueHead.next = NULL;
-	Osc_QueueTail = &Osc_QueueHead;
+static inline int
+Osc_SendBatch(struct Osc_Destination *dest)
+{
+	struct Osc_Batch	*batch = &dest->batch;
+	int			fd = dest->fd;
+	Uint32			sent = 0;
+
+	while (sent < batch->count) {
+		fd_set	wrset;
+		int	r;
+
+		struct timeval timeout = {
+			.tv_sec = 30,
+			.tv_usec = 0
+		};
+
+		Uint32 messages = 0;
+
+		FD_ZERO(&wrset);
+		FD_SET(fd, &wrset);
+
+		if (select(fd + 1, NULL, &wrset, NULL, &timeout) <= 0)
+			return 1;
 
-	return SDL_UnlockMutex(Osc_QueueMutex) ||
-	       SDL_SemPost(Osc_QueueSemaphore);
+#ifdef HAVE_SENDMMSG
+		for (Uint32 i = sent; i < batch->count; i++) {
+			struct mmsghdr *msg = batch->msgs + i - sent;
+
+			batch->iov[i].iov_base = batch->dgram[i].data;
+			batch->iov[i].iov_len = batch->dgram[i].size;
+
+			memset(msg, 0, sizeof(struct mmsghdr));
+			msg->msg_hdr.msg_iov = batch->iov + i;
+			msg->msg_hdr.msg_iovlen = 1;
+		}
+
+		do
+			r = sendmmsg(fd, batch->msgs, batch->count - sent, 0);
+		while (r < 0 && errno == EINTR);
+#else
+		do
+			r = send(fd, batch->dgram[sent].data,
+				 batch->dgram[sent].size, 0);
+		while (r < 0 && errno == EINTR);
+
+		if (r > 0)
+			r = 1;	/* datagrams sent */
+#endif
+
+		if (r <= 0)
+			return 1;
+
+		for (Uint32 i = sent; i < sent + r; i++)
+			messages += batch->dgram[i].messages;
+
+		/* before the slots are released */
+		Osc_ReleasePackets(dest, sent ? batch->dgram[sent - 1].end
+					      : batch->start,
+				   batch->dgram[sent + r - 1].end, Latency_Now());
+		sent += r;
+
+		ATOMIC_STORE(&dest->queue.tail, batch->dgram[sent - 1].end);
+
+		dest->stats.syscalls++;
+		dest->stats.datagrams += r;
+		dest->stats.messages += messages;
+		dest->stats.batches[Osc_BatchBucket(messages)]++;
+	}
+
+	return 0;
 }
 
 #define THREAD_ABORT() {			\
@@ -130,7 +790,8 @@ Osc_TerminateThread(void)
 static int SDLCALL
 Osc_DequeueThread(void *ud)
 {
-	int fd = *(int*)ud;
+	struct Osc_Destination	*dest = ud;
+	struct Osc_Queue	*queue = &dest->queue;
 
 	static const SDL_Event abort = {
 		.type = SDL_USEREVENT,
@@ -141,58 +802,57 @@ Osc_DequeueThread(void *ud)
 	};
 
 	for (;;) {
-		struct Osc_QueueElement	*el;
-		char			*data;
-
-		fd_set		wrset;
-		ssize_t		r;
+		switch (Osc_WaitQueue(queue)) {
+		case 0:
+			break;
 
-		struct timeval timeout = {
-			.tv_sec = 30,
-			.tv_usec = 0
-		};
+		case 1: /* gentle thread termination */
+			return 0;
 
-		if (SDL_SemWait(Osc_QueueSemaphore) ||
-		    SDL_LockMutex(Osc_QueueMutex))
+		default:
 			THREAD_ABORT();
-
-		if (!(el = Osc_QueueHead.next)) { /* gentle thread termination */
-			SDL_DestroyMutex(Osc_QueueMutex);
-			SDL_DestroySemaphore(Osc_QueueSemaphore);
-			Osc_QueueMutex = NULL;
-			Osc_QueueSemaphore = NULL;
-
-			return 0;
 		}
 
-		if (SDL_UnlockMutex(Osc_QueueMutex))
-			THREAD_ABORT();
+		if (osc_config.bundle) {
+			if (osc_config.bundle_delay)
+				Osc_WaitBundle(dest);
 
-		FD_ZERO(&wrset);
-		FD_SET(fd, &wrset);
+			Osc_CollectBundles(dest, ATOMIC_LOAD(&queue->head));
+		} else
+			Osc_CollectPackets(dest, ATOMIC_LOAD(&queue->head));
 
-		if (select(fd + 1, NULL, &wrset, NULL, &timeout) <= 0)
+		if (Osc_SendBatch(dest))
 			THREAD_ABORT();
+	}
+}
 
-		data = OSC_getPacket(&el->buffer);
+/*
+ * current time as OSC (NTP) time tag: seconds since 1900 and fraction
+ */
 
-		do
-			r = send(fd, data, OSC_packetSize(&el->buffer), 0);
-		while (r < 0 && errno == EINTR);
+static inline Uint64
+Osc_TimeTag(void)
+{
+	struct timeval tv;
 
-		if (r <= 0 ||
-		    SDL_LockMutex(Osc_QueueMutex))
-			THREAD_ABORT();
+	gettimeofday(&tv, NULL);
 
-		if (!(Osc_QueueHead.next = el->next))
-			Osc_QueueTail = &Osc_QueueHead;
+	return (Uint64)(tv.tv_sec + 2208988800UL) << 32 |
+	       ((Uint64)tv.tv_usec << 32)/1000000;
+}
 
-		if (SDL_UnlockMutex(Osc_QueueMutex))
-			THREAD_ABORT();
+/*
+ * called when enqueuing a packet for the input event currently handled
+ */
 
-		free(data);
-		free(el);
-	}
+static inline void
+Osc_StampPacket(struct Osc_Packet *packet)
+{
+	packet->timetag = Osc_TimeTag();
+
+	packet->input = Latency_Input;
+	packet->enqueued = Latency_Now();
+	Latency_Record(LATENCY_HANDLE, packet->enqueued - packet->input);
 }
 
 static inline Uint32
@@ -268,45 +928,428 @@ err:
 }
 #endif
 
-static inline int
-Osc_BuildFloatMessage(OSCbuf *buf, const char *address, float value)
+/*
+ * the type tag of every data type and the (maximum) size of its argument.
+ * bools are sent as ",T" or ",F" without argument bytes.
+ */
+static const struct Osc_Encoding {
+	const char	*types;
+	Uint32		size;
+} Osc_Encodings[] = {
+	[OSC_INT]	= {",i", sizeof(Uint32)},
+	[OSC_FLOAT]	= {",f", sizeof(Uint32)},
+	[OSC_DOUBLE]	= {",d", sizeof(Uint64)},
+	[OSC_STRING]	= {",s", OSC_STRING_SIZE},
+	[OSC_BOOL]	= {",T", 0},
+	[OSC_INT64]	= {",h", sizeof(Uint64)}
+};
+
+/*
+ * maximum size of the messages of a template
+ */
+
+static inline Uint32
+Osc_MaxSize(const struct Osc_Template *tmpl)
 {
-	Uint32	size = Osc_StrPad32(strlen(address)) + 4 + sizeof(float);
-	char	*data;
+	return tmpl->size + Osc_Encodings[tmpl->type].size;
+}
 
-	if (!(data = malloc(size)))
+/*
+ * the type tag is fixed by the data type here, so the encoders never have
+ * to check it
+ */
+
+int
+Osc_InitTemplate(struct Osc_Template *tmpl, const char *address,
+		 enum Osc_DataType type)
+{
+	OSCbuf buf;
+
+	if (*address != '/' ||
+	    (Uint32)type >= sizeof(Osc_Encodings)/sizeof(*Osc_Encodings))
 		return 1;
 
-	OSC_initBuffer(buf, size, data);
+	tmpl->type = type;
+	tmpl->size = Osc_StrPad32(strlen(address)) +
+		     Osc_StrPad32(strlen(Osc_Encodings[type].types));
+	if (tmpl->size + Osc_Encodings[type].size > OSC_PACKET_SIZE ||
+	    !(tmpl->data = malloc(tmpl->size)))
+		return 1;
+
+	OSC_initBuffer(&buf, tmpl->size, tmpl->data);
 
-	if (OSC_writeAddressAndTypes(buf, (char*)address, ",f") ||
-	    OSC_writeFloatArg(buf, value)) {
-		free(data);
+	if (OSC_writeAddressAndTypes(&buf, (char*)address,
+				     (char*)Osc_Encodings[type].types) ||
+	    OSC_packetSize(&buf) != tmpl->size) {
+		free(tmpl->data);
+		tmpl->data = NULL;
 		return 1;
 	}
 
 	return 0;
 }
 
+static inline void
+Osc_Put32(char *p, Uint32 v)
+{
+	*(Uint32 *)p = htonl(v);
+}
+
+static inline void
+Osc_Put64(char *p, Uint64 v)
+{
+	Osc_Put32(p, v >> 32);
+	Osc_Put32(p + sizeof(Uint32), v);
+}
+
+/*
+ * copy the message header into a packet buffer and append the argument,
+ * returns the packet size
+ */
+
+static inline Uint32
+Osc_Encode(char *data, const struct Osc_Template *tmpl, double value)
+{
+	char	*arg = data + tmpl->size;
+	Uint32	size = Osc_MaxSize(tmpl);
+
+	union {
+		float	f;
+		Uint32	i;
+	} f;
+	union {
+		double	d;
+		Uint64	i;
+	} d;
+
+	memcpy(data, tmpl->data, tmpl->size);
+
+	switch (tmpl->type) {
+	case OSC_INT:
+		Osc_Put32(arg, (Sint32)(value < 0 ? value - .5 : value + .5));
+		break;
+
+	case OSC_FLOAT:
+		f.f = value;
+		Osc_Put32(arg, f.i);
+		break;
+
+	case OSC_DOUBLE:
+		d.d = value;
+		Osc_Put64(arg, d.i);
+		break;
+
+	case OSC_INT64:
+		Osc_Put64(arg, (Sint64)(value < 0 ? value - .5 : value + .5));
+		break;
+
+	case OSC_BOOL:
+		/* patch the type tag following the comma */
+		data[tmpl->size - sizeof(Uint32) + 1] = value ? 'T' : 'F';
+		break;
+
+	case OSC_STRING: {
+		int l = snprintf(arg, OSC_STRING_SIZE, "%g", value);
+
+		size = tmpl->size + Osc_StrPad32(l);
+		memset(arg + l, 0, size - tmpl->size - l);
+		break;
+	}
+	}
+
+	return size;
+}
+
+/*
+ * encode the message directly into the next free slot of every ring, so
+ * neither side copies it. rings receive every update, even when
+ * coalescing, and drop messages while they are full.
+ */
+
+static inline void
+Osc_WriteRings(const struct Osc_Template *tmpl, double value)
+{
+#ifdef HAVE_SHM_OPEN
+	for (int r = 0; r < Osc_cRings; r++) {
+		struct Osc_Ring	*ring = Osc_Rings + r;
+		char		*data;
+
+		if (!ring->ring)
+			continue;	/* terminated */
+		if (!(data = Ring_Reserve(ring->ring))) {
+			ring->stats.overruns++;
+			continue;
+		}
+
+		Ring_Commit(ring->ring, Osc_Encode(data, tmpl, value));
+		ring->stats.messages++;
+	}
+#else
+	(void)tmpl;
+	(void)value;
+#endif
+}
+
+/*
+ * next unreferenced packet of the pool or NULL if all are queued
+ */
+
+static inline struct Osc_Packet *
+Osc_AllocPacket(void)
+{
+	for (Uint32 i = 0; i < OSC_POOL_SIZE; i++) {
+		struct Osc_Packet *packet = Osc_Pool +
+					    (Osc_PoolNext++ & (OSC_POOL_SIZE - 1));
+
+		/* pairs with the releasing drops of the last reference */
+		if (!ATOMIC_LOAD(&packet->refs))
+			return packet;
+	}
+
+	return NULL;
+}
+
+/*
+ * queue a packet for every destination whose queue is not full
+ */
+
+static inline int
+Osc_PushPacket(struct Osc_Packet *packet)
+{
+	Uint32	pushed = 0;
+	int	r = 0;
+
+	/* all references are taken before the first queue can drop one */
+	ATOMIC_STORE(&packet->refs, Osc_cDestinations);
+
+	for (int d = 0; d < Osc_cDestinations; d++) {
+		struct Osc_Destination	*dest = Osc_Destinations + d;
+		Uint32			head = dest->queue.head;
+
+		if (head - ATOMIC_LOAD(&dest->queue.tail) == OSC_QUEUE_SIZE) {
+			ATOMIC_SUB_RELEASE(&packet->refs, 1);
+			dest->stats.overruns++;
+			continue;
+		}
+
+		QUEUE_SLOT(&dest->queue, head) = packet;
+		ATOMIC_STORE(&dest->queue.head, head + 1);
+		pushed++;
+
+		if (Osc_WakeupThread(&dest->queue))
+			r = 1;
+	}
+
+	if (!pushed && packet->pending)
+		ATOMIC_STORE(&packet->pending->queued, 0);
+
+	return r;
+}
+
+/*
+ * called from the main thread only.
+ * the message is encoded once into a free packet of the pool, which is
+ * queued for all destinations, so enqueuing neither allocates memory nor
+ * blocks.
+ * if a destination's queue is full, the message is dropped for it.
+ */
+
 int
-Osc_EnqueueFloatMessage(const char *address, float value)
+Osc_EnqueueMessage(struct Osc_Template *tmpl, double value)
 {
-	struct Osc_QueueElement *el;
+	struct Osc_Packet *packet;
 
-	if (SDL_LockMutex(Osc_QueueMutex) ||
-	    !(el = malloc(sizeof(struct Osc_QueueElement))))
-		return 1;
-	memset(el, 0, sizeof(struct Osc_QueueElement));
+	Osc_WriteRings(tmpl, value);
+	if (!Osc_cDestinations)
+		return 0;
 
-	if (Osc_BuildFloatMessage(&el->buffer, address, value)) {
-		free(el);
-		return 1;
+	if (!(packet = Osc_AllocPacket())) {
+		for (int d = 0; d < Osc_cDestinations; d++)
+			Osc_Destinations[d].stats.overruns++;
+		return 0;
+	}
+
+	packet->pending = NULL;
+	Osc_StampPacket(packet);
+	packet->size = Osc_Encode(packet->data, tmpl, value);
+	packet->ready = 1;
+
+	return Osc_PushPacket(packet);
+}
+
+/*
+ * like Osc_EnqueueMessage(), but in coalescing mode there is at most
+ * one message per template in the queues: if it has not been sent yet, only
+ * its value is updated.
+ * the value is fetched and encoded by the OSC threads.
+ */
+
+int
+Osc_UpdateMessage(struct Osc_Template *tmpl, double value)
+{
+	struct Osc_Packet *packet;
+
+	union {
+		double	d;
+		Uint64	i;
+	} arg = {.d = value};
+
+	if (!osc_config.coalesce)
+		return Osc_EnqueueMessage(tmpl, value);
+
+	Osc_WriteRings(tmpl, value);
+	if (!Osc_cDestinations)
+		return 0;
+
+	ATOMIC_STORE(&tmpl->value, arg.i);
+	if (ATOMIC_EXCHANGE(&tmpl->queued, 1))
+		return 0;
+
+	if (!(packet = Osc_AllocPacket())) {
+		ATOMIC_STORE(&tmpl->queued, 0);
+		for (int d = 0; d < Osc_cDestinations; d++)
+			Osc_Destinations[d].stats.overruns++;
+		return 0;
+	}
+
+	packet->pending = tmpl;
+	packet->claimed = packet->ready = 0;
+	Osc_StampPacket(packet);
+
+	return Osc_PushPacket(packet);
+}
+
+/*
+ * number of messages sent so far, counted once for all destinations (i.e.
+ * those of the destination or ring that has been sent the most), so
+ * coalesced updates are not counted
+ */
+
+Uint32
+Osc_MessageCount(void)
+{
+	Uint32 messages = 0;
+
+	for (int d = 0; d < Osc_cDestinations + Osc_cRings; d++) {
+		struct Osc_Stats *cur = d < Osc_cDestinations
+					? &Osc_Destinations[d].stats
+					: &Osc_Rings[d - Osc_cDestinations].stats;
+		Uint32 n = ATOMIC_LOAD(&cur->messages);
+
+		if (n > messages)
+			messages = n;
 	}
 
-	Osc_QueueTail->next = el;
-	Osc_QueueTail = el;
+	return messages;
+}
+
+/*
+ * number of messages waiting to be sent to (or read from) the slowest
+ * destination
+ */
+
+Uint32
+Osc_QueueDepth(void)
+{
+	Uint32 depth = 0;
+
+	for (int d = 0; d < Osc_cDestinations; d++) {
+		struct Osc_Queue *queue = &Osc_Destinations[d].queue;
+		Uint32 n = ATOMIC_LOAD(&queue->head) - ATOMIC_LOAD(&queue->tail);
+
+		if (n > depth)
+			depth = n;
+	}
+
+#ifdef HAVE_SHM_OPEN
+	for (int r = 0; r < Osc_cRings; r++) {
+		struct Ring *ring = Osc_Rings[r].ring;
+		Uint32 n;
+
+		if (!ring)
+			continue;
+
+		n = ring->next - ATOMIC_LOAD(&ring->header->tail);
+		if (n > depth)
+			depth = n;
+	}
+#endif
 
-	return SDL_UnlockMutex(Osc_QueueMutex) ||
-	       SDL_SemPost(Osc_QueueSemaphore);
+	return depth;
 }
 
+/*
+ * wait until all queued packets have been sent (or consumed from the rings),
+ * at most timeout ms; returns nonzero if packets are still queued
+ */
+
+int
+Osc_Drain(Uint32 timeout)
+{
+	Uint32 deadline = SDL_GetTicks() + timeout;
+
+	while (Osc_QueueDepth()) {
+		if ((Sint32)(SDL_GetTicks() - deadline) >= 0)
+			return 1;
+		SDL_Delay(1);
+	}
+
+	return 0;
+}
+
+/*
+ * statistics summed over all destinations, rings count messages and
+ * overruns only
+ */
+
+void
+Osc_SumStats(struct Osc_Stats *stats)
+{
+	memset(stats, 0, sizeof(struct Osc_Stats));
+
+	for (int d = 0; d < Osc_cDestinations + Osc_cRings; d++) {
+		struct Osc_Stats *cur = d < Osc_cDestinations
+					? &Osc_Destinations[d].stats
+					: &Osc_Rings[d - Osc_cDestinations].stats;
+
+		stats->messages += cur->messages;
+		stats->datagrams += cur->datagrams;
+		stats->syscalls += cur->syscalls;
+		stats->overruns += cur->overruns;
+
+		for (int b = 0; b < OSC_STATS_BUCKETS; b++)
+			stats->batches[b] += cur->batches[b];
+	}
+}
+
+void
+Osc_DumpStats(FILE *stream)
+{
+	for (int d = 0; d < Osc_cDestinations; d++) {
+		struct Osc_Stats *stats = &Osc_Destinations[d].stats;
+
+		fprintf(stream, "OSC destination %d:\n"
+				"OSC messages sent:\t%u\n"
+				"Datagrams sent:\t\t%u\n"
+				"System calls:\t\t%u\n"
+				"Dropped messages:\t%u\n"
+				"Messages per system call:\n",
+			d, stats->messages, stats->datagrams,
+			stats->syscalls, stats->overruns);
+
+		for (int b = 0; b < OSC_STATS_BUCKETS - 1; b++)
+			fprintf(stream, "\t%u-%u:\t%u\n",
+				1 << b, (2 << b) - 1, stats->batches[b]);
+		fprintf(stream, "\t%u+:\t%u\n", 1 << (OSC_STATS_BUCKETS - 1),
+			stats->batches[OSC_STATS_BUCKETS - 1]);
+	}
+
+	for (int r = 0; r < Osc_cRings; r++) {
+		struct Osc_Stats *stats = &Osc_Rings[r].stats;
+
+		fprintf(stream, "OSC ring %d:\n"
+				"OSC messages written:\t%u\n"
+				"Dropped messages:\t%u\n",
+			r, stats->messages, stats->overruns);
+	}
+}
@@ -2,11 +2,13 @@
 #ifndef __OSC_H
 #define __OSC_H
 
+#include <stdio.h>
 #include <unistd.h>
 #ifdef __WATCOMC__
 #include <types.h>
 #endif
 #include <sys/socket.h>
+#include <netinet/in.h>
 
 #include <SDL.h>
 #include <SDL_thread.h>
@@ -29,33 +31,95 @@ enum {
 };
 #endif
 
-int Osc_Connect(const char *hostname, int port);
-static inline void Osc_Disconnect(int fd);
-
-SDL_Thread *Osc_InitThread(int *fd);
-int Osc_TerminateThread(void);
-
-int Osc_EnqueueFloatMessage(const char *address, float value);
-
-static inline void
-Osc_Disconnect(int fd)
-{
-	shutdown(fd, SHUT_WR);
-	close(fd);
-}
-
 enum Osc_DataType {
 	OSC_INT = 0,
 	OSC_FLOAT,
 	OSC_DOUBLE,
 	OSC_STRING,
-	OSC_BOOL
+	OSC_BOOL,
+	OSC_INT64
 };
 #define OSC_DATATYPE	\
 	"int\0"		\
 	"float\0"	\
 	"double\0"	\
 	"string\0"	\
-	"bool\0"
+	"bool\0"		\
+	"int64\0"
+
+/*
+ * pre-encoded OSC message header (address and type tag) of a control,
+ * built once when loading the interface. the argument is appended by the
+ * encoder of the control's data type.
+ */
+struct Osc_Template {
+	enum Osc_DataType type;
+
+	char		*data;
+	Uint32		size;
+
+			/* pending coalesced update (bits of a double) */
+	volatile Uint64	value;
+	volatile int	queued;
+};
+
+extern struct Osc_Config {
+	int	coalesce;	/* latest-value-wins updates */
+
+	int	bundle;		/* pack queued messages into bundles */
+	Uint32	bundle_delay;	/* max. time to wait for more messages (ms) */
+
+	int	stats;		/* print statistics on exit */
+
+			/* for multicast group destinations */
+	int	multicast_ttl;	/* max. number of hops */
+	int	multicast_loop;	/* deliver to receivers on this host */
+	char	*multicast_if;	/* address of interface to use or NULL */
+} osc_config;
+
+#define OSC_DESTINATIONS 8	/* max. number of destinations */
+#define OSC_UNIX_PREFIX	"unix:"	/* of Unix domain socket destinations */
+#define OSC_SHM_PREFIX	"shm:"	/* of shared memory ring destinations */
+
+/*
+ * sending statistics of a destination, updated by its OSC thread
+ */
+#define OSC_STATS_BUCKETS 8
+
+struct Osc_Stats {
+	Uint32	messages;
+	Uint32	datagrams;
+	Uint32	syscalls;
+	Uint32	overruns;	/* messages dropped on full queue */
+
+	Uint32	batches[OSC_STATS_BUCKETS]; /* log2 histogram of messages
+					       per system call */
+};
+
+int Osc_Connect(const char *hostname, int port);
+int Osc_MulticastInterface(struct in_addr *iface);
+static inline void Osc_Disconnect(int fd);
+
+int Osc_AddDestinations(const char *hosts, const char *ports);
+int Osc_Socket(void);
+int Osc_Drain(Uint32 timeout);
+int Osc_TerminateThreads(void);
+
+int Osc_InitTemplate(struct Osc_Template *tmpl, const char *address,
+		     enum Osc_DataType type);
+int Osc_EnqueueMessage(struct Osc_Template *tmpl, double value);
+int Osc_UpdateMessage(struct Osc_Template *tmpl, double value);
+
+Uint32 Osc_MessageCount(void);
+Uint32 Osc_QueueDepth(void);
+void Osc_SumStats(struct Osc_Stats *stats);
+void Osc_DumpStats(FILE *stream);
+
+static inline void
+Osc_Disconnect(int fd)
+{
+	shutdown(fd, SHUT_WR);
+	close(fd);
+}
 
 #endif
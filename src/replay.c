@@ -0,0 +1,331 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <SDL.h>
+#include <SDL_thread.h>
+
+#include "controller.h"
+#include "atomics.h"
+#include "replay.h"
+
+/*
+ * recording of the input events retrieved by the main loop and their
+ * replay through the SDL event queue.
+ * events are recorded as retrieved, before motion events are folded, so
+ * the recording does not depend on the speed of the recording main loop.
+ * replaying them as fast as possible (one at a time, waiting for each to be
+ * dispatched) always reproduces the same value updates and OSC messages.
+ * replaying in real time reproduces the recorded timing instead.
+ * after the last event, the controller quits once the OSC threads have sent
+ * all queued messages (s.a. REPLAY_DRAIN).
+ *
+ * recordings start with REPLAY_MAGIC, followed by records of
+ * REPLAY_RECORD_SIZE bytes in network byte order: ticks since the start of
+ * the recording (32 bit), event type (8 bit), mouse button or state (8 bit),
+ * x coordinate or key symbol (16 bit), y coordinate (16 bit), relative
+ * x and y motion (16 bit each)
+ */
+
+#define REPLAY_MAGIC		"VOSCrec1"
+#define REPLAY_RECORD_SIZE	14
+
+#define REPLAY_POLL	100	/* ms, to check for termination */
+
+struct Replay_Config replay_config = {
+	.realtime = 0
+};
+
+static struct Replay_State {
+	FILE		*file;
+	Uint32		start;		/* ticks */
+
+	SDL_sem		*dispatched;	/* when replaying as fast as possible */
+	volatile int	terminate;
+} Replay_Recording, Replay_Playback;
+
+static int SDLCALL Replay_Thread(void *ud);
+
+static inline int Replay_IsInput(Uint8 type);
+static inline void Replay_Encode(Uint8 *record, Uint32 ticks,
+				 const SDL_Event *event);
+static inline int Replay_Decode(const Uint8 *record, Uint32 *ticks,
+				SDL_Event *event);
+
+static inline int
+Replay_IsInput(Uint8 type)
+{
+	switch (type) {
+	case SDL_KEYUP:
+	case SDL_MOUSEMOTION:
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+		return 1;
+	}
+
+	return 0;
+}
+
+static inline void
+Replay_Encode(Uint8 *record, Uint32 ticks, const SDL_Event *event)
+{
+	Uint16 v[4] = {0, 0, 0, 0};
+
+	ticks = SDL_SwapBE32(ticks);
+	memcpy(record, &ticks, sizeof(Uint32));
+
+	record[4] = event->type;
+	record[5] = 0;
+
+	switch (event->type) {
+	case SDL_KEYUP:
+		v[0] = event->key.keysym.sym;
+		break;
+
+	case SDL_MOUSEMOTION:
+		record[5] = event->motion.state;
+		v[0] = event->motion.x;
+		v[1] = event->motion.y;
+		v[2] = event->motion.xrel;
+		v[3] = event->motion.yrel;
+		break;
+
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+		record[5] = event->button.button;
+		v[0] = event->button.x;
+		v[1] = event->button.y;
+		break;
+	}
+
+	for (int i = 0; i < 4; i++)
+		v[i] = SDL_SwapBE16(v[i]);
+	memcpy(record + 6, v, sizeof(v));
+}
+
+/*
+ * returns nonzero for unknown event types
+ */
+
+static inline int
+Replay_Decode(const Uint8 *record, Uint32 *ticks, SDL_Event *event)
+{
+	Uint32	t;
+	Uint16	v[4];
+
+	memcpy(&t, record, sizeof(Uint32));
+	*ticks = SDL_SwapBE32(t);
+
+	memcpy(v, record + 6, sizeof(v));
+	for (int i = 0; i < 4; i++)
+		v[i] = SDL_SwapBE16(v[i]);
+
+	memset(event, 0, sizeof(SDL_Event));
+	event->type = record[4];
+
+	switch (event->type) {
+	case SDL_KEYUP:
+		event->key.state = SDL_RELEASED;
+		event->key.keysym.sym = v[0];
+		return 0;
+
+	case SDL_MOUSEMOTION:
+		event->motion.state = record[5];
+		event->motion.x = v[0];
+		event->motion.y = v[1];
+		event->motion.xrel = (Sint16)v[2];
+		event->motion.yrel = (Sint16)v[3];
+		return 0;
+
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+		event->button.button = record[5];
+		event->button.state = event->type == SDL_MOUSEBUTTONDOWN ?
+						SDL_PRESSED : SDL_RELEASED;
+		event->button.x = v[0];
+		event->button.y = v[1];
+		return 0;
+	}
+
+	return 1;
+}
+
+int
+Replay_StartRecording(const char *file)
+{
+	if (!(Replay_Recording.file = fopen(file, "wb")))
+		return 1;
+
+	if (fwrite(REPLAY_MAGIC, sizeof(REPLAY_MAGIC) - 1, 1,
+		   Replay_Recording.file) != 1) {
+		fclose(Replay_Recording.file);
+		Replay_Recording.file = NULL;
+		return 1;
+	}
+
+	Replay_Recording.start = SDL_GetTicks();
+	return 0;
+}
+
+/*
+ * called by the main thread for every retrieved event (including folded
+ * motion events), other than input events are ignored
+ */
+
+int
+Replay_Record(const SDL_Event *event)
+{
+	Uint8 record[REPLAY_RECORD_SIZE];
+
+	if (!Replay_Recording.file || !Replay_IsInput(event->type))
+		return 0;
+
+	Replay_Encode(record, SDL_GetTicks() - Replay_Recording.start, event);
+
+	return fwrite(record, sizeof(record), 1, Replay_Recording.file) != 1;
+}
+
+int
+Replay_StopRecording(void)
+{
+	int r;
+
+	if (!Replay_Recording.file)
+		return 0;
+
+	r = fclose(Replay_Recording.file);
+	Replay_Recording.file = NULL;
+
+	return r;
+}
+
+/*
+ * input from the window is ignored while replaying
+ */
+
+SDL_Thread *
+Replay_InitThread(const char *file)
+{
+	SDL_Thread	*thread;
+	char		magic[sizeof(REPLAY_MAGIC) - 1];
+
+	if (!(Replay_Playback.file = fopen(file, "rb")))
+		return NULL;
+
+	if (fread(magic, sizeof(magic), 1, Replay_Playback.file) != 1 ||
+	    memcmp(magic, REPLAY_MAGIC, sizeof(magic)) ||
+	    !(Replay_Playback.dispatched = SDL_CreateSemaphore(0)))
+		goto err;
+
+	Replay_Playback.terminate = 0;
+
+	SDL_EventState(SDL_KEYDOWN, SDL_IGNORE);
+	SDL_EventState(SDL_KEYUP, SDL_IGNORE);
+	SDL_EventState(SDL_MOUSEMOTION, SDL_IGNORE);
+	SDL_EventState(SDL_MOUSEBUTTONDOWN, SDL_IGNORE);
+	SDL_EventState(SDL_MOUSEBUTTONUP, SDL_IGNORE);
+
+	if (!(thread = SDL_CreateThread(Replay_Thread, NULL))) {
+		SDL_DestroySemaphore(Replay_Playback.dispatched);
+		goto err;
+	}
+
+	return thread;
+
+err:
+
+	fclose(Replay_Playback.file);
+	return NULL;
+}
+
+void
+Replay_TerminateThread(SDL_Thread *thread)
+{
+	ATOMIC_STORE(&Replay_Playback.terminate, 1);
+	SDL_SemPost(Replay_Playback.dispatched);
+
+	SDL_WaitThread(thread, NULL);
+
+	SDL_DestroySemaphore(Replay_Playback.dispatched);
+	fclose(Replay_Playback.file);
+}
+
+/*
+ * called by the main thread for every dispatched event
+ */
+
+int
+Replay_Acknowledge(const SDL_Event *event)
+{
+	return !replay_config.realtime && Replay_IsInput(event->type) &&
+	       SDL_SemPost(Replay_Playback.dispatched);
+}
+
+#define THREAD_ABORT() {			\
+	if (SDL_PushEvent((SDL_Event*)&abort))	\
+		return 1;			\
+	return 0;				\
+}
+
+static int SDLCALL
+Replay_Thread(void *ud)
+{
+	Uint8		record[REPLAY_RECORD_SIZE];
+	SDL_Event	event;
+	Uint32		ticks;
+
+	static const SDL_Event abort = {
+		.type = SDL_USEREVENT,
+		.user = {
+			.type = SDL_USEREVENT,
+			.code = CONTROLLER_ERR_THREAD
+		}
+	};
+	static const SDL_Event quit = {
+		.type = SDL_QUIT
+	};
+
+	(void)ud;
+
+	Replay_Playback.start = SDL_GetTicks();
+
+	while (fread(record, sizeof(record), 1, Replay_Playback.file) == 1) {
+		if (Replay_Decode(record, &ticks, &event))
+			continue;
+
+		if (replay_config.realtime) {
+			Sint32 wait;
+
+			while ((wait = Replay_Playback.start + ticks -
+				       SDL_GetTicks()) > 0) {
+				if (ATOMIC_LOAD(&Replay_Playback.terminate))
+					return 0;
+				SDL_Delay(wait < REPLAY_POLL ? wait : REPLAY_POLL);
+			}
+		}
+
+		while (SDL_PushEvent(&event)) { /* queue is full */
+			if (ATOMIC_LOAD(&Replay_Playback.terminate))
+				return 0;
+			SDL_Delay(1);
+		}
+
+		if (!replay_config.realtime &&
+		    SDL_SemWait(Replay_Playback.dispatched))
+			THREAD_ABORT();
+
+		if (ATOMIC_LOAD(&Replay_Playback.terminate))
+			return 0;
+	}
+
+	if (ferror(Replay_Playback.file))
+		THREAD_ABORT();
+
+	if (SDL_PushEvent((SDL_Event*)&quit))
+		THREAD_ABORT();
+
+	return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef __REPLAY_H
+#define __REPLAY_H
+
+#include <SDL.h>
+#include <SDL_thread.h>
+
+#define REPLAY_DRAIN	5000	/* ms, for the OSC threads to send the rest */
+
+extern struct Replay_Config {
+	int	realtime;	/* replay with the recorded timing */
+} replay_config;
+
+int Replay_StartRecording(const char *file);
+int Replay_Record(const SDL_Event *event);
+int Replay_StopRecording(void);
+
+SDL_Thread *Replay_InitThread(const char *file);
+void Replay_TerminateThread(SDL_Thread *thread);
+int Replay_Acknowledge(const SDL_Event *event);
+
+#endif
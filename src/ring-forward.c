@@ -0,0 +1,159 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "ring.h"
+
+/*
+ * example consumer of a shared memory ring destination ("shm:NAME"),
+ * forwarding every OSC packet as UDP datagram for engines that cannot read
+ * the ring themselves.
+ * waits for the controller to create the ring and terminates after the
+ * controller has terminated and all packets have been forwarded.
+ */
+
+#define FORWARD_RING	"osc"
+#define FORWARD_HOST	"localhost"
+#define FORWARD_PORT	77777
+#define FORWARD_RETRY	100	/* ms between attempts to open the ring */
+
+#ifdef HAVE_SHM_OPEN
+
+static int
+Connect(const char *hostname, int port)
+{
+	struct hostent		*entry;
+	struct sockaddr_in	addr;
+	int			fd;
+
+	if (!(entry = gethostbyname(hostname)) ||
+	    (fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(struct sockaddr_in));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = *(in_addr_t*)*entry->h_addr_list;
+	addr.sin_port = htons(port);
+
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_in)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void
+Usage(const char *name)
+{
+	printf("Usage: %s [-h] [-n NAME] [-r HOST] [-p PORT] [-b]\n"
+	       "\t-h\t\tShow this help\n"
+	       "\t-n NAME\t\tRing to read (default: %s)\n"
+	       "\t-r HOST\t\tHost to forward to (default: %s)\n"
+	       "\t-p PORT\t\tPort to forward to (default: %d)\n"
+	       "\t-b\t\tBusy-poll the ring instead of sleeping\n",
+	       name, FORWARD_RING, FORWARD_HOST, FORWARD_PORT);
+}
+
+int
+main(int argc, char **argv)
+{
+	char		*name = FORWARD_RING;
+	char		*host = FORWARD_HOST;
+	int		port = FORWARD_PORT;
+	int		timeout = -1;	/* ms to wait, s.a. Ring_Wait() */
+
+	struct Ring	*ring;
+	int		fd, opt;
+	unsigned long	packets = 0, failed = 0;
+
+	struct timespec retry = {
+		.tv_sec = 0,
+		.tv_nsec = FORWARD_RETRY*1000000L
+	};
+
+	while ((opt = getopt(argc, argv, "hn:r:p:b")) != -1)
+		switch (opt) {
+		case 'n':
+			name = optarg;
+			break;
+		case 'r':
+			host = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'b':
+			timeout = 0;
+			break;
+		case 'h':
+			Usage(*argv);
+			return EXIT_SUCCESS;
+		default:
+			Usage(*argv);
+			return EXIT_FAILURE;
+		}
+
+	if ((fd = Connect(host, port)) < 0) {
+		perror("Couldn't connect forwarding socket");
+		return EXIT_FAILURE;
+	}
+
+	while (!(ring = Ring_Open(name))) {
+		if (errno != ENOENT && errno != EAGAIN) {
+			perror("Couldn't open ring");
+			close(fd);
+			return EXIT_FAILURE;
+		}
+		nanosleep(&retry, NULL);
+	}
+
+	while (Ring_Wait(ring, timeout) >= 0) {
+		const char	*data;
+		uint32_t	size;
+
+		/* forward everything available before waiting again */
+		while ((data = Ring_Peek(ring, &size))) {
+			if (send(fd, data, size, 0) < 0)
+				failed++;
+			else
+				packets++;
+
+			Ring_Release(ring);
+		}
+	}
+
+	Ring_Close(ring);
+	close(fd);
+
+	printf("Packets forwarded:\t%lu\n"
+	       "Packets not sent:\t%lu\n",
+	       packets, failed);
+
+	return EXIT_SUCCESS;
+}
+
+#else
+
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+
+	fprintf(stderr, "%s: shared memory is not supported.\n", *argv);
+	return EXIT_FAILURE;
+}
+
+#endif
@@ -0,0 +1,330 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_SHM_OPEN
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#include "atomics.h"
+#include "ring.h"
+
+/*
+ * the consumer announces that it is going to sleep in the "waiting" flag
+ * and waits on the head index (a futex on Linux, otherwise it polls), so
+ * the producer only makes a system call to wake it up.
+ * packets are encoded by the producer directly into the reserved slot and
+ * read by the consumer from the slot (zero-copy).
+ */
+
+#define RING_SIZE	(sizeof(struct Ring_Header) + \
+			 RING_SLOTS*sizeof(struct Ring_Slot))
+#define RING_SLOT(R, I)	((R)->slots + ((I) & (RING_SLOTS - 1)))
+
+#define RING_POLL	1	/* ms between polls without futexes */
+
+static struct Ring *Ring_Map(const char *name, int create);
+static void Ring_Unmap(struct Ring *ring);
+static inline void Ring_Wake(struct Ring_Header *header);
+static inline long Ring_Ticks(void);
+static inline int Ring_Sleep(struct Ring_Header *header, uint32_t head,
+			     int timeout);
+
+/*
+ * shared memory object names must start with a slash
+ */
+
+static struct Ring *
+Ring_Map(const char *name, int create)
+{
+	struct Ring	*ring;
+	struct stat	st;
+	void		*p;
+	int		fd;
+
+	if (!(ring = calloc(1, sizeof(struct Ring))) ||
+	    !(ring->name = malloc(strlen(name) + 2)))
+		goto err;
+	strcpy(ring->name, *name == '/' ? "" : "/");
+	strcat(ring->name, name);
+
+	fd = create ? shm_open(ring->name, O_RDWR | O_CREAT | O_TRUNC, 0644)
+		    : shm_open(ring->name, O_RDWR, 0);
+	if (fd < 0)
+		goto err;
+
+	if ((create && ftruncate(fd, RING_SIZE)) ||
+	    fstat(fd, &st) || st.st_size < (off_t)RING_SIZE ||
+	    (p = mmap(NULL, RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+		      fd, 0)) == MAP_FAILED) {
+		close(fd);
+		if (create)
+			shm_unlink(ring->name);
+		goto err;
+	}
+	close(fd);
+
+	ring->header = p;
+	ring->slots = (struct Ring_Slot *)(ring->header + 1);
+	ring->size = RING_SIZE;
+
+	return ring;
+
+err:
+
+	if (ring)
+		free(ring->name);
+	free(ring);
+	return NULL;
+}
+
+static void
+Ring_Unmap(struct Ring *ring)
+{
+	munmap(ring->header, ring->size);
+	free(ring->name);
+	free(ring);
+}
+
+static inline void
+Ring_Wake(struct Ring_Header *header)
+{
+	ATOMIC_FENCE();	/* publish head before checking the waiting flag */
+
+	if (ATOMIC_EXCHANGE(&header->waiting, 0)) {
+#ifdef __linux__
+		syscall(SYS_futex, &header->head, FUTEX_WAKE, 1,
+			NULL, NULL, 0);
+#endif
+	}
+}
+
+/*
+ * monotonic time in ms
+ */
+
+static inline long
+Ring_Ticks(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000L + ts.tv_nsec/1000000L;
+}
+
+/*
+ * sleep until the head index changes or the timeout (ms) expires, returns
+ * 0 on timeout and -1 on error.
+ * it may return early (signals, spurious wakeups or polling), so callers
+ * have to check their deadline.
+ * the futex is not private, as the ring is shared between processes.
+ */
+
+static inline int
+Ring_Sleep(struct Ring_Header *header, uint32_t head, int timeout)
+{
+#ifdef __linux__
+	struct timespec ts = {
+		.tv_sec = timeout/1000,
+		.tv_nsec = timeout%1000*1000000L
+	};
+
+	if (syscall(SYS_futex, &header->head, FUTEX_WAIT, head,
+		    timeout < 0 ? NULL : &ts, NULL, 0) &&
+	    errno != EAGAIN && errno != EINTR)
+		return errno == ETIMEDOUT ? 0 : -1;
+
+	return 1;
+#else
+	struct timespec ts = {
+		.tv_sec = 0,
+		.tv_nsec = RING_POLL*1000000L
+	};
+
+	(void)header;
+	(void)head;
+	(void)timeout;
+
+	nanosleep(&ts, NULL);
+	return 1;
+#endif
+}
+
+struct Ring *
+Ring_Create(const char *name)
+{
+	struct Ring *ring;
+
+	if (!(ring = Ring_Map(name, 1)))
+		return NULL;
+
+	memset(ring->header, 0, sizeof(struct Ring_Header));
+	ring->header->slots = RING_SLOTS;
+	ring->header->packet_size = RING_PACKET_SIZE;
+
+	/* consumers may attach as soon as the magic is set */
+	ATOMIC_FENCE();
+	memcpy(ring->header->magic, RING_MAGIC, sizeof(ring->header->magic));
+
+	return ring;
+}
+
+/*
+ * free slot to encode the next packet into or NULL if the ring is full
+ */
+
+char *
+Ring_Reserve(struct Ring *ring)
+{
+	if (ring->next - ATOMIC_LOAD(&ring->header->tail) == RING_SLOTS)
+		return NULL;
+
+	return RING_SLOT(ring, ring->next)->data;
+}
+
+/*
+ * publish the packet encoded into the reserved slot
+ */
+
+void
+Ring_Commit(struct Ring *ring, uint32_t size)
+{
+	RING_SLOT(ring, ring->next)->size = size;
+	ATOMIC_STORE(&ring->header->head, ++ring->next);
+
+	Ring_Wake(ring->header);
+}
+
+/*
+ * the consumer may still read the remaining packets, its Ring_Wait()
+ * fails afterwards
+ */
+
+void
+Ring_Destroy(struct Ring *ring)
+{
+	ATOMIC_STORE(&ring->header->closed, 1);
+	Ring_Wake(ring->header);
+
+	shm_unlink(ring->name);
+	Ring_Unmap(ring);
+}
+
+/*
+ * fails with errno ENOENT if the producer has not created the ring yet
+ * and EAGAIN if it is not (yet) initialized
+ */
+
+struct Ring *
+Ring_Open(const char *name)
+{
+	struct Ring *ring;
+
+	if (!(ring = Ring_Map(name, 0)))
+		return NULL;
+
+	ATOMIC_FENCE();
+	if (memcmp(ring->header->magic, RING_MAGIC,
+		   sizeof(ring->header->magic)) ||
+	    ring->header->slots != RING_SLOTS ||
+	    ring->header->packet_size != RING_PACKET_SIZE) {
+		/* may still be initialized by the producer */
+		Ring_Unmap(ring);
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	ring->next = ATOMIC_LOAD(&ring->header->tail);
+	return ring;
+}
+
+/*
+ * wait at most timeout ms (-1: indefinitely, 0: just poll) for a packet.
+ * returns 1 if a packet is available, 0 on timeout and -1 on error or if
+ * the producer has terminated and all packets have been read.
+ */
+
+int
+Ring_Wait(struct Ring *ring, int timeout)
+{
+	struct Ring_Header	*header = ring->header;
+	long			deadline = timeout > 0 ? Ring_Ticks() + timeout : 0;
+
+	for (;;) {
+		uint32_t head = ATOMIC_LOAD(&header->head);
+		int r;
+
+		if (head != ring->next)
+			return 1;
+		if (ATOMIC_LOAD(&header->closed))
+			return -1;
+		if (!timeout)
+			return 0;
+		if (timeout > 0 && (timeout = deadline - Ring_Ticks()) <= 0)
+			return 0;
+
+		ATOMIC_EXCHANGE(&header->waiting, 1);
+		ATOMIC_FENCE();	/* announce waiting before rechecking head */
+
+		if (ATOMIC_LOAD(&header->head) != head ||
+		    ATOMIC_LOAD(&header->closed)) {
+			ATOMIC_EXCHANGE(&header->waiting, 0);
+			continue;
+		}
+
+		if ((r = Ring_Sleep(header, head, timeout)) <= 0) {
+			ATOMIC_EXCHANGE(&header->waiting, 0);
+			if (!r && ATOMIC_LOAD(&header->head) != ring->next)
+				return 1;
+			return r;
+		}
+	}
+}
+
+/*
+ * next packet (in the shared memory) or NULL if there is none
+ */
+
+const char *
+Ring_Peek(struct Ring *ring, uint32_t *size)
+{
+	struct Ring_Slot *slot;
+
+	if (ATOMIC_LOAD(&ring->header->head) == ring->next)
+		return NULL;
+
+	slot = RING_SLOT(ring, ring->next);
+	*size = slot->size < RING_PACKET_SIZE ? slot->size : RING_PACKET_SIZE;
+
+	return slot->data;
+}
+
+/*
+ * return the slot of the packet returned by Ring_Peek() to the producer
+ */
+
+void
+Ring_Release(struct Ring *ring)
+{
+	ATOMIC_STORE(&ring->header->tail, ++ring->next);
+}
+
+void
+Ring_Close(struct Ring *ring)
+{
+	Ring_Unmap(ring);
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef __RING_H
+#define __RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * single-producer/single-consumer ring of OSC packets in POSIX shared
+ * memory (/dev/shm on Linux), written by the controller and read by
+ * engines on the same host without any system call in the common case.
+ * the reader API does not depend on libSDL, so consumers only need
+ * ring.c, ring.h and atomics.h.
+ */
+
+#define RING_MAGIC		"VOSCrng1"
+#define RING_SLOTS		1024	/* must be a power of 2 */
+#define RING_PACKET_SIZE	256	/* max. OSC packet size */
+#define RING_CACHELINE		64
+
+struct Ring_Header {
+	char		magic[8];
+	uint32_t	slots;
+	uint32_t	packet_size;
+
+	/* head and tail on separate cache lines */
+	char		pad0[RING_CACHELINE - 16];
+	volatile uint32_t head;		/* written by producer only */
+	volatile uint32_t closed;	/* producer terminated */
+	char		pad1[RING_CACHELINE - 8];
+	volatile uint32_t tail;		/* written by consumer only */
+	volatile uint32_t waiting;	/* consumer waits on head */
+	char		pad2[RING_CACHELINE - 8];
+};
+
+struct Ring_Slot {
+	uint32_t	size;
+	uint32_t	reserved;
+	char		data[RING_PACKET_SIZE];
+};
+
+struct Ring {
+	struct Ring_Header	*header;
+	struct Ring_Slot	*slots;
+	size_t			size;	/* of mapping */
+
+	uint32_t		next;	/* local copy of head or tail */
+	char			*name;	/* of shared memory object */
+};
+
+/* producer */
+struct Ring *Ring_Create(const char *name);
+char *Ring_Reserve(struct Ring *ring);
+void Ring_Commit(struct Ring *ring, uint32_t size);
+void Ring_Destroy(struct Ring *ring);
+
+/* consumer */
+struct Ring *Ring_Open(const char *name);
+int Ring_Wait(struct Ring *ring, int timeout);
+const char *Ring_Peek(struct Ring *ring, uint32_t *size);
+void Ring_Release(struct Ring *ring);
+void Ring_Close(struct Ring *ring);
+
+#endif
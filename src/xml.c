@@ -13,6 +13,9 @@
 
 #include "controls.h"
 #include "controller.h"
+#include "osc.h"
+#include "dispatch.h"
+#include "hittest.h"
 #include "xml.h"
 
 #define FOREACH_ATTR(VAR, ATTS) \
@@ -133,6 +136,10 @@ Interface_StartElement(void *ud, const XML_Char *name, const XML_Char **atts)
 					goto err;
 
 				display.background = SDL_MapRGB(s->format, color.r, color.g, color.b);
+			} else if (!strcasecmp(*a, "destinations")) {
+				free(registry.destinations);
+				if (!(registry.destinations = strdup(a[1])))
+					goto allocerr;
 			} else
 				goto err;
 	} else if (!strcasecmp(name, "tab")) {
@@ -174,6 +181,7 @@ Interface_StartElement(void *ud, const XML_Char *name, const XML_Char **atts)
 		control = tab->controls + tab->cControls - 1;
 		memset(control, 0, sizeof(struct Control));
 				/* ^ already sets some default values (0/NULL) */
+		control->OSC.datatype = OSC_FLOAT;
 
 		FOREACH_ATTR(a, atts)
 			if (!strcasecmp(*a, "geo")) {
@@ -197,6 +205,11 @@ Interface_StartElement(void *ud, const XML_Char *name, const XML_Char **atts)
 					goto err;
 			}
 
+		if (control->OSC.address &&
+		    Osc_InitTemplate(&control->OSC.template, control->OSC.address,
+				     control->OSC.datatype))
+			goto err;
+
 				/* control-specific */
 
 		if (!strcasecmp(name, "slider")) {
@@ -373,6 +386,15 @@ Xml_ReadInterface(const char *file, SDL_Surface *surface)
 
 	XML_ParserFree(parser);
 	fclose(f);
-	return !registry.tabs;
+
+	if (!registry.tabs)
+		return 1;
+
+	for (struct Tab *tab = registry.tabs;
+	     tab < registry.tabs + registry.cTabs; tab++)
+		if (HitTest_BuildGrid(&tab->grid, tab->controls, tab->cControls))
+			return 1;
+
+	return Dispatch_BuildIndex();
 }
 